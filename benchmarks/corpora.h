@@ -0,0 +1,218 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+
+/** Generators of the benchmark corpora.
+
+    The corpora are generated from a fixed seed so that they are identical on every run and every machine, and no large files have to be distributed with the benchmark. Each generator appends complete lines or frames until the requested size is reached.
+ */
+namespace corpora {
+
+    /** Simple deterministic xorshift generator.
+     */
+    class Random {
+    public:
+        explicit Random(uint64_t seed = 0x2545f4914f6cdd1d):
+            state_{seed} {
+        }
+
+        uint64_t next() {
+            state_ ^= state_ << 13;
+            state_ ^= state_ >> 7;
+            state_ ^= state_ << 17;
+            return state_;
+        }
+
+        /** Returns a random number in the [0, max) range.
+         */
+        unsigned operator () (unsigned max) {
+            return static_cast<unsigned>(next() % max);
+        }
+
+    private:
+        uint64_t state_;
+    };
+
+    inline void AppendUTF8(std::string & s, char32_t cp) {
+        if (cp < 0x80) {
+            s += static_cast<char>(cp);
+        } else if (cp < 0x800) {
+            s += static_cast<char>(0xc0 | (cp >> 6));
+            s += static_cast<char>(0x80 | (cp & 0x3f));
+        } else if (cp < 0x10000) {
+            s += static_cast<char>(0xe0 | (cp >> 12));
+            s += static_cast<char>(0x80 | ((cp >> 6) & 0x3f));
+            s += static_cast<char>(0x80 | (cp & 0x3f));
+        } else {
+            s += static_cast<char>(0xf0 | (cp >> 18));
+            s += static_cast<char>(0x80 | ((cp >> 12) & 0x3f));
+            s += static_cast<char>(0x80 | ((cp >> 6) & 0x3f));
+            s += static_cast<char>(0x80 | (cp & 0x3f));
+        }
+    }
+
+    inline void AppendWord(std::string & s, Random & r) {
+        for (unsigned i = 0, e = 1 + r(10); i < e; ++i)
+            s += static_cast<char>('a' + r(26));
+    }
+
+    /** Dense printable ASCII, such as the output of `find /` or a compiler, lines of random words of varying length.
+     */
+    inline std::string ASCII(size_t size) {
+        Random r;
+        std::string result;
+        result.reserve(size + 256);
+        while (result.size() < size) {
+            for (unsigned i = 0, e = r(16); i < e; ++i) {
+                AppendWord(result, r);
+                result += r(8) == 0 ? '/' : ' ';
+            }
+            result += "\r\n";
+        }
+        return result;
+    }
+
+    /** Colourful output, such as `ls --color` or syntax highlighters, every word has its own SGR attributes, mixing the 16, 256 and true colour forms.
+     */
+    inline std::string SGR(size_t size) {
+        Random r;
+        std::string result;
+        result.reserve(size + 256);
+        while (result.size() < size) {
+            for (unsigned i = 0, e = r(12); i < e; ++i) {
+                switch (r(5)) {
+                    case 0:
+                        result += "\033[" + std::to_string(30 + r(8)) + "m";
+                        break;
+                    case 1:
+                        result += "\033[1;" + std::to_string(90 + r(8)) + ";" + std::to_string(40 + r(8)) + "m";
+                        break;
+                    case 2:
+                        result += "\033[38;5;" + std::to_string(r(256)) + "m";
+                        break;
+                    case 3:
+                        result += "\033[38;2;" + std::to_string(r(256)) + ";" + std::to_string(r(256)) + ";" + std::to_string(r(256)) + "m";
+                        break;
+                    default:
+                        result += "\033[4;48;5;" + std::to_string(r(256)) + "m";
+                        break;
+                }
+                AppendWord(result, r);
+                result += "\033[0m ";
+            }
+            result += "\r\n";
+        }
+        return result;
+    }
+
+    /** Non-ASCII text, accented latin, greek, cyrillic, CJK ideographs and emoji, i.e. all UTF-8 encoding lengths and double width characters.
+     */
+    inline std::string Unicode(size_t size) {
+        Random r;
+        std::string result;
+        result.reserve(size + 256);
+        while (result.size() < size) {
+            for (unsigned i = 0, e = r(10); i < e; ++i) {
+                for (unsigned j = 0, je = 1 + r(6); j < je; ++j) {
+                    switch (r(5)) {
+                        case 0:
+                            AppendUTF8(result, 0xc0 + r(0x40));
+                            break;
+                        case 1:
+                            AppendUTF8(result, 0x3b1 + r(25));
+                            break;
+                        case 2:
+                            AppendUTF8(result, 0x430 + r(32));
+                            break;
+                        case 3:
+                            AppendUTF8(result, 0x4e00 + r(0x5000));
+                            break;
+                        default:
+                            AppendUTF8(result, 0x1f600 + r(0x50));
+                            break;
+                    }
+                }
+                result += ' ';
+            }
+            result += "\r\n";
+        }
+        return result;
+    }
+
+    /** Full screen application, such as `htop` or an editor, on the alternate screen.
+
+        Each frame positions the cursor on every row and rewrites it with coloured fields and erases the rest of the line, followed by a number of small updates at random positions and a reverse video status bar.
+     */
+    inline std::string TUI(size_t size, int cols, int rows) {
+        Random r;
+        std::string result;
+        result.reserve(size + 256 * static_cast<size_t>(rows));
+        result += "\033[?1049h\033[?25l";
+        while (result.size() < size) {
+            result += "\033[H";
+            for (int row = 1; row < rows; ++row) {
+                result += "\033[" + std::to_string(row) + ";1H";
+                for (int col = 0; col < cols - 12; col += 12) {
+                    result += "\033[" + std::to_string(30 + r(8)) + "m";
+                    result += std::to_string(r(100000));
+                    result += ' ';
+                    AppendWord(result, r);
+                }
+                result += "\033[0m\033[K";
+            }
+            for (unsigned i = 0; i < 32; ++i) {
+                result += "\033[" + std::to_string(1 + r(rows - 1)) + ";" + std::to_string(1 + r(cols - 8)) + "H";
+                result += "\033[1m" + std::to_string(r(1000)) + "\033[22m";
+            }
+            result += "\033[" + std::to_string(rows) + ";1H\033[7m";
+            result += std::string(cols - 1, ' ');
+            result += "\033[0m";
+        }
+        result += "\033[?25h\033[?1049l";
+        return result;
+    }
+
+    /** Output scrolling within a scroll region, such as a pager or a chat client with a fixed header and footer.
+
+        Mixes lines scrolled by line feeds at the bottom of the region, reverse index at its top and explicit line insertions, deletions and scrolls.
+     */
+    inline std::string ScrollRegion(size_t size, int cols, int rows) {
+        Random r;
+        std::string result;
+        result.reserve(size + 256);
+        std::string top{std::to_string(2)};
+        std::string bottom{std::to_string(rows - 1)};
+        result += "\033[" + top + ";" + bottom + "r";
+        while (result.size() < size) {
+            switch (r(8)) {
+                case 0:
+                    result += "\033[" + top + ";1H\033M";
+                    AppendWord(result, r);
+                    break;
+                case 1:
+                    result += "\033[" + std::to_string(2 + r(rows - 2)) + ";1H\033[" + std::to_string(1 + r(4)) + "L";
+                    break;
+                case 2:
+                    result += "\033[" + std::to_string(2 + r(rows - 2)) + ";1H\033[" + std::to_string(1 + r(4)) + "M";
+                    break;
+                case 3:
+                    result += "\033[" + std::to_string(1 + r(4)) + (r(2) == 0 ? "S" : "T");
+                    break;
+                default:
+                    result += "\033[" + bottom + ";1H";
+                    for (unsigned i = 0, e = 1 + r(8); i < e; ++i) {
+                        for (int col = 0; col < cols / 2; col += 8) {
+                            AppendWord(result, r);
+                            result += ' ';
+                        }
+                        result += "\r\n";
+                    }
+                    break;
+            }
+        }
+        result += "\033[r";
+        return result;
+    }
+
+} // namespace corpora
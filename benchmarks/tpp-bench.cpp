@@ -0,0 +1,244 @@
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <iomanip>
+#include <mutex>
+#include <condition_variable>
+#include <new>
+#include <vector>
+
+#include "helpers/helpers.h"
+#include "tpp-lib/pty_recording.h"
+#include "ui-terminal/ansi_terminal.h"
+
+#include "corpora.h"
+
+/** Headless throughput benchmark of the terminal.
+
+    Feeds the standard corpora, or PTY recordings, to an AnsiTerminal with no renderer attached through a replay pseudoterminal and reports the throughput of the whole input pipeline, i.e. reading from the pseudoterminal, parsing and updating the buffer and history, and the number of heap allocations per megabyte of input, the memory the terminal occupies at the end, which `--memory` limits, and the peak number of bytes read from the pseudoterminal that were waiting to be parsed, which shows how far parsing fell behind the reader.
+
+    Usage: tpp-bench [--size MB] [--repeat N] [--cols N] [--rows N] [--history N] [--memory KB] [--replay FILE] [--realtime] [corpus...]
+
+    Recordings are replayed as fast as possible, unless `--realtime` is given, on a terminal of the size they were recorded with.
+ */
+
+namespace {
+
+    std::atomic<size_t> Allocations_{0};
+
+#if (defined _MSC_VER)
+#define BENCH_NOINLINE __declspec(noinline)
+#else
+#define BENCH_NOINLINE __attribute__((noinline))
+#endif
+
+    /** The memory of the replaced operators is obtained and released only here.
+
+        Neither function may be inlined, otherwise the compiler sees free() called on memory returned by operator new and warns about mismatched deallocation.
+     */
+    BENCH_NOINLINE void * Allocate(size_t size) {
+        ++Allocations_;
+        if (void * result = std::malloc(size == 0 ? 1 : size))
+            return result;
+        throw std::bad_alloc{};
+    }
+
+    BENCH_NOINLINE void Release(void * ptr) noexcept {
+        std::free(ptr);
+    }
+
+} // anonymous namespace
+
+/** Counts all heap allocations so that allocations per megabyte of input can be reported.
+ */
+void * operator new (size_t size) {
+    return Allocate(size);
+}
+
+void * operator new [] (size_t size) {
+    return Allocate(size);
+}
+
+void operator delete (void * ptr) noexcept {
+    Release(ptr);
+}
+
+void operator delete [] (void * ptr) noexcept {
+    Release(ptr);
+}
+
+void operator delete (void * ptr, size_t) noexcept {
+    Release(ptr);
+}
+
+void operator delete [] (void * ptr, size_t) noexcept {
+    Release(ptr);
+}
+
+namespace {
+
+    using namespace ui;
+
+    /** Terminal which signals when all of its input has been processed.
+     */
+    class BenchTerminal : public AnsiTerminal {
+    public:
+        explicit BenchTerminal(tpp::ReplayPTYMaster * pty):
+            AnsiTerminal{pty, Palette::XTerm256()},
+            done_{false} {
+        }
+
+        void waitDone() {
+            std::unique_lock<std::mutex> g{m_};
+            cv_.wait(g, [this](){ return done_; });
+        }
+
+    protected:
+        void ptyTerminated(ExitCode exitCode) override {
+            MARK_AS_UNUSED(exitCode);
+            {
+                std::lock_guard<std::mutex> g{m_};
+                done_ = true;
+            }
+            cv_.notify_all();
+        }
+
+    private:
+        bool done_;
+        std::mutex m_;
+        std::condition_variable cv_;
+    };
+
+    struct Options {
+        size_t size = 16 * 1024 * 1024;
+        unsigned repeat = 5;
+        int cols = 80;
+        int rows = 25;
+        int history = 10000;
+        size_t memory = 0;
+        bool realTime = false;
+        std::vector<std::string> corpora;
+        std::vector<std::string> recordings;
+    };
+
+    struct Result {
+        double seconds;
+        size_t allocations;
+        /** Memory occupied by the terminal at the end of the run, including its history. */
+        size_t memory;
+        /** Largest number of bytes read from the PTY that were waiting to be parsed. */
+        size_t queue;
+    };
+
+    Result Run(tpp::PTYRecording const & recording, Options const & options) {
+        tpp::ReplayPTYMaster * pty = new tpp::ReplayPTYMaster{recording, options.realTime};
+        BenchTerminal * terminal = new BenchTerminal{pty};
+        terminal->setMaxHistoryRows(options.history);
+        terminal->setMemoryLimit(options.memory);
+        auto size = recording.size();
+        if (size.first == 0)
+            size = std::make_pair(options.cols, options.rows);
+        terminal->resize(Size{size.first, size.second});
+        size_t allocations = Allocations_;
+        auto start = std::chrono::steady_clock::now();
+        pty->start();
+        terminal->waitDone();
+        auto end = std::chrono::steady_clock::now();
+        allocations = Allocations_ - allocations;
+        size_t memory = terminal->memoryUsage().total();
+        size_t queue = terminal->maxInputQueueDepth();
+        // deletes the pty as well
+        delete terminal;
+        return Result{std::chrono::duration<double>(end - start).count(), allocations, memory, queue};
+    }
+
+    std::string Generate(std::string const & corpus, Options const & options) {
+        if (corpus == "ascii")
+            return corpora::ASCII(options.size);
+        if (corpus == "sgr")
+            return corpora::SGR(options.size);
+        if (corpus == "unicode")
+            return corpora::Unicode(options.size);
+        if (corpus == "tui")
+            return corpora::TUI(options.size, options.cols, options.rows);
+        if (corpus == "scroll")
+            return corpora::ScrollRegion(options.size, options.cols, options.rows);
+        THROW(Exception()) << "Unknown corpus " << corpus;
+    }
+
+    Options ParseArguments(int argc, char * argv[]) {
+        Options result;
+        for (int i = 1; i < argc; ++i) {
+            std::string arg{argv[i]};
+            if (arg[0] != '-') {
+                result.corpora.push_back(arg);
+                continue;
+            }
+            if (arg == "--realtime") {
+                result.realTime = true;
+                continue;
+            }
+            if (i + 1 == argc)
+                THROW(Exception()) << "Missing value of " << arg;
+            if (arg == "--replay") {
+                result.recordings.push_back(argv[++i]);
+                continue;
+            }
+            unsigned long value = std::stoul(argv[++i]);
+            if (arg == "--size")
+                result.size = value * 1024 * 1024;
+            else if (arg == "--repeat")
+                result.repeat = std::max(static_cast<unsigned>(value), 1u);
+            else if (arg == "--cols")
+                result.cols = std::max(static_cast<int>(value), 20);
+            else if (arg == "--rows")
+                result.rows = std::max(static_cast<int>(value), 5);
+            else if (arg == "--history")
+                result.history = static_cast<int>(value);
+            else if (arg == "--memory")
+                result.memory = value * 1024;
+            else
+                THROW(Exception()) << "Unknown option " << arg;
+        }
+        if (result.corpora.empty() && result.recordings.empty())
+            result.corpora = { "ascii", "sgr", "unicode", "tui", "scroll" };
+        return result;
+    }
+
+    /** Runs the recording the given number of times and reports the fastest run, which is the least affected by the noise of the machine.
+     */
+    void Report(std::string const & name, tpp::PTYRecording const & recording, Options const & options) {
+        Result best{0, 0, 0, 0};
+        for (unsigned i = 0; i < options.repeat; ++i) {
+            Result r{Run(recording, options)};
+            if (i == 0 || r.seconds < best.seconds)
+                best = r;
+        }
+        double mb = static_cast<double>(recording.outputSize()) / (1024 * 1024);
+        std::cout << std::left << std::setw(10) << name << std::right << std::fixed
+            << std::setprecision(2) << std::setw(10) << mb
+            << std::setw(12) << (mb / best.seconds)
+            << std::setw(12) << (best.seconds * 1e9 / static_cast<double>(recording.outputSize()))
+            << std::setprecision(0) << std::setw(14) << (static_cast<double>(best.allocations) / mb)
+            << std::setw(12) << (best.memory / 1024)
+            << std::setw(10) << (best.queue / 1024)
+            << std::endl;
+    }
+
+} // anonymous namespace
+
+int main(int argc, char * argv[]) {
+    try {
+        Options options{ParseArguments(argc, argv)};
+        std::cout << "terminal " << options.cols << "x" << options.rows << ", history " << options.history << (options.memory == 0 ? "" : STR(", memory " << options.memory / 1024 << "KB")) << ", best of " << options.repeat << " runs" << std::endl;
+        std::cout << std::left << std::setw(10) << "corpus" << std::right << std::setw(10) << "MB" << std::setw(12) << "MB/s" << std::setw(12) << "ns/byte" << std::setw(14) << "allocs/MB" << std::setw(12) << "memory KB" << std::setw(10) << "queue KB" << std::endl;
+        for (auto const & corpus : options.corpora)
+            Report(corpus, tpp::PTYRecording::FromOutput(Generate(corpus, options)), options);
+        for (auto const & filename : options.recordings)
+            Report(filename, tpp::PTYRecording::Load(filename), options);
+        return EXIT_SUCCESS;
+    } catch (std::exception const & e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+}
@@ -0,0 +1,179 @@
+#pragma once
+
+#include <algorithm>
+#include <deque>
+#include <type_traits>
+
+#include "helpers.h"
+
+HELPERS_NAMESPACE_BEGIN
+
+    /** Arena of trivial objects which are freed in the order they were allocated.
+
+        The objects are allocated in contiguous runs at the tail of large chunks. A run which does not fit in the rest of the tail chunk starts a new one and runs larger than the chunk size get a chunk of their own. Runs must be freed in the same order as they were allocated, but a run can be freed in consecutive parts.
+
+        Chunks whose runs have all been freed are kept as a spare for the next chunk, so that a queue whose size does not grow, such as a size limited history, allocates no memory once it is full. Both allocating and freeing are O(1).
+     */
+    template<typename T>
+    class FifoArena {
+        static_assert(std::is_trivially_copyable<T>::value && std::is_trivially_destructible<T>::value, "Only trivial objects can be stored in FifoArena");
+    public:
+
+        /** Default number of objects per chunk.
+         */
+        static constexpr size_t DEFAULT_CHUNK_SIZE = 65536;
+
+        explicit FifoArena(size_t chunkSize = DEFAULT_CHUNK_SIZE):
+            chunkSize_{chunkSize} {
+            ASSERT(chunkSize > 0);
+        }
+
+        FifoArena(FifoArena && from) noexcept:
+            chunkSize_{from.chunkSize_},
+            chunks_{std::move(from.chunks_)},
+            head_{from.head_},
+            spare_{from.spare_} {
+            from.chunks_.clear();
+            from.head_ = 0;
+            from.spare_ = nullptr;
+        }
+
+        FifoArena & operator = (FifoArena && from) noexcept {
+            if (this != & from) {
+                clear();
+                chunkSize_ = from.chunkSize_;
+                chunks_ = std::move(from.chunks_);
+                head_ = from.head_;
+                spare_ = from.spare_;
+                from.chunks_.clear();
+                from.head_ = 0;
+                from.spare_ = nullptr;
+            }
+            return *this;
+        }
+
+        FifoArena(FifoArena const &) = delete;
+        FifoArena & operator = (FifoArena const &) = delete;
+
+        ~FifoArena() {
+            clear();
+        }
+
+        /** Returns the number of chunks in use.
+         */
+        size_t chunks() const {
+            return chunks_.size();
+        }
+
+        /** Allocates a run of given number of objects, which are left uninitialized.
+         */
+        T * allocate(size_t size) {
+            if (size == 0)
+                return nullptr;
+            if (chunks_.empty() || chunks_.back().capacity - chunks_.back().used < size)
+                addChunk(size);
+            Chunk & tail = chunks_.back();
+            T * result = tail.data + tail.used;
+            tail.used += size;
+            return result;
+        }
+
+        /** Grows the most recently allocated run of given size by given number of objects, which are left uninitialized, and returns the run.
+
+            A run which no longer fits in its chunk is moved to a new chunk. Runs larger than the chunk size get twice the space they need so that a run growing repeatedly is copied only a logarithmic number of times.
+         */
+        T * extend(T * run, size_t size, size_t by) {
+            if (size == 0)
+                return allocate(by);
+            ASSERT(! chunks_.empty() && run + size == chunks_.back().data + chunks_.back().used) << "Only the most recent run can be extended";
+            if (chunks_.back().capacity - chunks_.back().used >= by) {
+                chunks_.back().used += by;
+                return run;
+            }
+            size_t newSize = size + by;
+            addChunk(newSize > chunkSize_ ? newSize * 2 : newSize);
+            Chunk & tail = chunks_.back();
+            std::copy(run, run + size, tail.data);
+            tail.used = newSize;
+            // the chunk the run moved from is released if the run was the only one left in it
+            size_t old = chunks_.size() - 2;
+            chunks_[old].used -= size;
+            if (old == 0 && chunks_[old].used == head_) {
+                releaseHeadChunk();
+            } else if (old != 0 && chunks_[old].used == 0) {
+                if (chunks_[old].capacity == chunkSize_ && spare_ == nullptr)
+                    spare_ = chunks_[old].data;
+                else
+                    delete [] chunks_[old].data;
+                chunks_.erase(chunks_.begin() + static_cast<std::ptrdiff_t>(old));
+            }
+            return tail.data;
+        }
+
+        /** Frees given number of objects at the start of the oldest allocated run.
+         */
+        void free(T const * run, size_t size) {
+            if (size == 0)
+                return;
+            ASSERT(! chunks_.empty());
+            ASSERT(run == chunks_.front().data + head_ && head_ + size <= chunks_.front().used) << "Runs must be freed in the order of their allocation";
+            MARK_AS_UNUSED(run);
+            head_ += size;
+            // the unused end of a chunk is skipped with its last run
+            if (head_ == chunks_.front().used) {
+                if (chunks_.size() > 1) {
+                    releaseHeadChunk();
+                } else {
+                    chunks_.front().used = 0;
+                    head_ = 0;
+                }
+            }
+        }
+
+    private:
+
+        struct Chunk {
+            T * data;
+            size_t capacity;
+            size_t used;
+        };
+
+        void addChunk(size_t size) {
+            if (size <= chunkSize_ && spare_ != nullptr) {
+                chunks_.push_back(Chunk{spare_, chunkSize_, 0});
+                spare_ = nullptr;
+            } else {
+                size_t capacity = std::max(size, chunkSize_);
+                chunks_.push_back(Chunk{new T[capacity], capacity, 0});
+            }
+        }
+
+        void releaseHeadChunk() {
+            Chunk & head = chunks_.front();
+            if (head.capacity == chunkSize_ && spare_ == nullptr)
+                spare_ = head.data;
+            else
+                delete [] head.data;
+            chunks_.pop_front();
+            head_ = 0;
+        }
+
+        void clear() {
+            for (Chunk & chunk : chunks_)
+                delete [] chunk.data;
+            chunks_.clear();
+            delete [] spare_;
+            spare_ = nullptr;
+            head_ = 0;
+        }
+
+        size_t chunkSize_;
+        std::deque<Chunk> chunks_;
+        /** Offset of the oldest allocated object in the head chunk.
+         */
+        size_t head_ = 0;
+        T * spare_ = nullptr;
+
+    }; // FifoArena
+
+HELPERS_NAMESPACE_END
@@ -2,6 +2,10 @@
 
 #include "helpers.h"
 
+#if (defined _MSC_VER)
+#include <intrin.h>
+#endif
+
 HELPERS_NAMESPACE_BEGIN
 
     /** Sets or clears the given mask. 
@@ -21,5 +25,20 @@ HELPERS_NAMESPACE_BEGIN
         return (value & ~ mask) | bits;
     } 
 
+    /** Returns the number of trailing zero bits in the given value. 
+     
+        The value must not be zero. 
+     */
+    inline unsigned CountTrailingZeros(uint32_t value) {
+        ASSERT(value != 0);
+#if (defined _MSC_VER)
+        unsigned long result;
+        _BitScanForward(&result, value);
+        return static_cast<unsigned>(result);
+#else
+        return static_cast<unsigned>(__builtin_ctz(value));
+#endif
+    }
+
 
 HELPERS_NAMESPACE_END
\ No newline at end of file
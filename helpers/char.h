@@ -1,8 +1,19 @@
 #pragma once
 
+#include <algorithm>
 #include <ostream>
 
 #include "helpers.h"
+#include "bits.h"
+#include "char_width.h"
+
+#if (defined __SSE2__ || defined _M_X64 || (defined _M_IX86_FP && _M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define HELPERS_CHAR_SSE2
+#elif (defined __ARM_NEON && defined __aarch64__)
+#include <arm_neon.h>
+#define HELPERS_CHAR_NEON
+#endif
 
 #ifdef ARCH_WINDOWS
 static_assert(sizeof(wchar_t) == sizeof(char16_t), "wchar_t and char16_t must have the same size or the conversions would break");
@@ -27,6 +38,106 @@ HELPERS_NAMESPACE_BEGIN
 	class CharError : public IOError {
 	};
 
+    /** Splits the codepoints into blocks for the ColumnWidthTable and determines which blocks consist of codepoints of the same width. 
+     */
+    class ColumnWidthBlocks {
+    protected:
+
+        static constexpr char32_t MAX_CODEPOINT = 0x110000;
+        static constexpr size_t BLOCK_SIZE = 256;
+        static constexpr size_t BLOCK_BYTES = BLOCK_SIZE / 4;
+        static constexpr size_t NUM_BLOCKS = MAX_CODEPOINT / BLOCK_SIZE;
+        static constexpr size_t NUM_RANGES = sizeof(COLUMN_WIDTH_RANGES) / sizeof(ColumnWidthRange);
+
+        /** Returns the width of all codepoints in the block, or -1 if their widths differ. 
+         
+            Skips the ranges preceding the block, the blocks must therefore be queried in order. 
+         */
+        static constexpr int UniformWidth(size_t block, size_t & range) {
+            char32_t first = static_cast<char32_t>(block * BLOCK_SIZE);
+            char32_t last = first + BLOCK_SIZE - 1;
+            while (range < NUM_RANGES && COLUMN_WIDTH_RANGES[range].last < first)
+                ++range;
+            if (range == NUM_RANGES || COLUMN_WIDTH_RANGES[range].first > last)
+                return 1;
+            if (COLUMN_WIDTH_RANGES[range].first <= first && COLUMN_WIDTH_RANGES[range].last >= last)
+                return COLUMN_WIDTH_RANGES[range].width;
+            return -1;
+        }
+
+        static constexpr size_t MixedBlocks() {
+            size_t result = 0;
+            size_t range = 0;
+            for (size_t block = 0; block < NUM_BLOCKS; ++block)
+                if (UniformWidth(block, range) < 0)
+                    ++result;
+            return result;
+        }
+
+    }; // ColumnWidthBlocks
+
+    /** Two-stage lookup table of the column widths of all codepoints, built at compile time from COLUMN_WIDTH_RANGES. 
+
+        The codepoints are split into blocks of 256. The first stage maps each block to its widths in the second stage, each width taking 2 bits. Most blocks consist of codepoints of the same width and share one of the three uniform blocks in the second stage so that only the blocks with mixed widths are stored. 
+     */
+    class ColumnWidthTable : public ColumnWidthBlocks {
+    public:
+
+        constexpr ColumnWidthTable():
+            blocks_{},
+            widths_{} {
+            for (size_t i = 0; i < BLOCK_BYTES; ++i) {
+                widths_[BLOCK_BYTES + i] = 0x55;
+                widths_[2 * BLOCK_BYTES + i] = 0xaa;
+            }
+            size_t range = 0;
+            size_t next = 3;
+            for (size_t block = 0; block < NUM_BLOCKS; ++block) {
+                int uniform = UniformWidth(block, range);
+                if (uniform >= 0) {
+                    blocks_[block] = static_cast<unsigned char>(uniform);
+                    continue;
+                }
+                // a block of mixed widths, set all to 1 and then the widths from all ranges intersecting the block
+                blocks_[block] = static_cast<unsigned char>(next);
+                unsigned char * widths = widths_ + next * BLOCK_BYTES;
+                for (size_t i = 0; i < BLOCK_BYTES; ++i)
+                    widths[i] = 0x55;
+                char32_t first = static_cast<char32_t>(block * BLOCK_SIZE);
+                char32_t last = first + BLOCK_SIZE - 1;
+                for (size_t i = range; i < NUM_RANGES && COLUMN_WIDTH_RANGES[i].first <= last; ++i) {
+                    ColumnWidthRange const & r = COLUMN_WIDTH_RANGES[i];
+                    for (char32_t cp = std::max(r.first, first), e = std::min(r.last, last); cp <= e; ++cp) {
+                        size_t index = cp - first;
+                        unsigned shift = index % 4 * 2;
+                        widths[index / 4] = static_cast<unsigned char>((widths[index / 4] & ~(3u << shift)) | (r.width << shift));
+                    }
+                }
+                ++next;
+            }
+        }
+
+        /** Returns the column width of given codepoint, codepoints outside of the unicode range are 1 column wide. 
+         */
+        constexpr int operator () (char32_t cp) const {
+            if (cp >= MAX_CODEPOINT)
+                return 1;
+            unsigned char const * widths = widths_ + blocks_[cp / BLOCK_SIZE] * BLOCK_BYTES;
+            size_t index = cp % BLOCK_SIZE;
+            return (widths[index / 4] >> (index % 4 * 2)) & 3;
+        }
+
+    private:
+
+        static_assert(3 + MixedBlocks() <= 256, "Block indices must fit in a byte");
+
+        unsigned char blocks_[NUM_BLOCKS];
+        unsigned char widths_[(3 + MixedBlocks()) * BLOCK_BYTES];
+
+    }; // ColumnWidthTable
+
+    inline constexpr ColumnWidthTable COLUMN_WIDTHS{};
+
 	/** UTF8 character representation. 
 	 */
 	class Char {
@@ -221,6 +332,10 @@ HELPERS_NAMESPACE_BEGIN
 		static constexpr char CR = 13;
 		static constexpr char ESC = 27;
 
+        /** Zero width joiner, joins the surrounding characters into a single grapheme cluster. 
+         */
+        static constexpr char32_t ZWJ = 0x200d;
+
 		Char(char c = ' ') :
 			bytes_{ static_cast<unsigned char>(c), 0, 0, 0 } {
 			ASSERT(c >= 0) << "ASCII out of range";
@@ -339,25 +454,12 @@ HELPERS_NAMESPACE_BEGIN
 
 		/** Returns number of columns in monospace font (such as a terminal) the given character should occupy. 
 
-		    On linux, the funtion wcwidth should do, however this does not exist on Windows and to make sure that applications behave the same on all platforms, own decission is implemented. 
+		    On linux, the funtion wcwidth should do, however this does not exist on Windows and to make sure that applications behave the same on all platforms, own decission is implemented. The widths are 0 for combining marks and other zero width characters, 2 for wide characters including emoji and 1 for everything else, see tools/unicode_width.py for details. 
 		 */
-        static int ColumnWidth(char32_t cp) {
-			if (cp >= 0x1100) {
-				if (cp <= 0x115f || // Hangul
-				    cp == 0x2329 ||
-					cp == 0x2321 ||
-					(cp >= 0x2e80 && cp <= 0xa4cf && cp != 0x303f) || // CJK
-					(cp >= 0xac00 && cp <= 0xd7a3) || // Hangul Syllables
-					(cp >= 0xf900 && cp <= 0xfaff) || // CJK
-					(cp >= 0xfe10 && cp <= 0xfe19) || // Vertical forms
-					(cp >= 0xfe30 && cp <= 0xfe6f) || // CJK
-					(cp >= 0xff00 && cp <= 0xff60) || // Fullwidth forms
-					(cp >= 0xffe0 && cp <= 0xffe6) ||
-					(cp >= 0x20000 && cp <= 0x2fffd) ||
-					(cp >= 0x30000 && cp <= 0x3fffd))
-					return 2;
-			}
-			return 1;
+        static constexpr int ColumnWidth(char32_t cp) {
+            if (cp < 0x80)
+                return 1;
+            return COLUMN_WIDTHS(cp);
 		}
 
         static int ColumnWidth(Char const & c) {
@@ -593,6 +695,40 @@ HELPERS_NAMESPACE_BEGIN
         }
     }
 
+	/** Returns the first character in the given range that is not printable ASCII, or the end of the range if all characters are printable. 
+
+	    Control characters, DEL and any bytes belonging to multi-byte UTF8 encodings are not printable ASCII. Where available, SIMD instructions are used to check 16 bytes at once as the function is used by the terminal to find runs of plain text in its input. 
+	 */
+	inline char const * FindNonPrintableASCII(char const * begin, char const * end) {
+#if (defined HELPERS_CHAR_SSE2)
+		__m128i const low = _mm_set1_epi8(0x1f);
+		__m128i const high = _mm_set1_epi8(0x7f);
+		while (end - begin >= 16) {
+			__m128i x = _mm_loadu_si128(pointer_cast<__m128i const *>(begin));
+			// the comparison is signed so that bytes >= 0x80 fail the lower bound check too
+			__m128i printable = _mm_and_si128(_mm_cmpgt_epi8(x, low), _mm_cmplt_epi8(x, high));
+			uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(printable)) ^ 0xffff;
+			if (mask != 0)
+				return begin + CountTrailingZeros(mask);
+			begin += 16;
+		}
+#elif (defined HELPERS_CHAR_NEON)
+		uint8x16_t const low = vdupq_n_u8(0x20);
+		uint8x16_t const high = vdupq_n_u8(0x7f);
+		while (end - begin >= 16) {
+			uint8x16_t x = vld1q_u8(pointer_cast<uint8_t const *>(begin));
+			uint8x16_t printable = vandq_u8(vcgeq_u8(x, low), vcltq_u8(x, high));
+			// if any of the bytes is not printable, let the scalar loop below find it
+			if (vminvq_u8(printable) == 0)
+				break;
+			begin += 16;
+		}
+#endif
+		while (begin != end && static_cast<unsigned char>(*begin) - 0x20u < 0x5fu)
+			++begin;
+		return begin;
+	}
+
 	/** Converts given character containing a decimal digit to its value.
 	 */
 	inline unsigned DecCharToNumber(char what) {
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+#include "helpers.h"
+
+HELPERS_NAMESPACE_BEGIN
+
+    /** Fast LZ77 compression of data kept in memory.
+
+        The format follows the LZ4 block format: a sequence starts with a token whose high nibble is the number of literals and low nibble the match length minus 4, either being extended by following bytes when the nibble is 15. The literals follow, then the 2 byte little endian offset of the match and the match length extension. The last sequence only has literals. Matches are found by a small hash table of 4 byte sequences, which favors speed over the ratio.
+
+        The decompressed size is not stored and must be known to the decompression.
+     */
+    inline void LZCompress(char const * data, size_t size, std::string & into) {
+        constexpr size_t MIN_MATCH = 4;
+        constexpr size_t MAX_OFFSET = 65535;
+        constexpr unsigned HASH_BITS = 12;
+        // matches can't be found closer to the end than this
+        constexpr size_t LAST_LITERALS = 5;
+        // after this many failed attempts the search starts skipping bytes, so that incompressible data is processed quickly
+        constexpr unsigned SKIP_TRIGGER = 4;
+        uint32_t table[1 << HASH_BITS];
+        memset(table, 0xff, sizeof(table));
+        unsigned char const * src = pointer_cast<unsigned char const *>(data);
+        // the output is written directly to the string resized to the worst case size and trimmed afterwards
+        size_t start = into.size();
+        into.resize(start + size + size / 255 + 16);
+        char * out = into.data() + start;
+        auto read32 = [src](size_t at) {
+            uint32_t result;
+            memcpy(& result, src + at, sizeof(result));
+            return result;
+        };
+        auto writeLength = [& out](size_t length) {
+            for (; length >= 255; length -= 255)
+                *out++ = static_cast<char>(255);
+            *out++ = static_cast<char>(length);
+        };
+        auto writeSequence = [&](size_t literalsStart, size_t literals, size_t offset, size_t matchLength) {
+            size_t matchNibble = matchLength - (matchLength == 0 ? 0 : MIN_MATCH);
+            *out++ = static_cast<char>((std::min<size_t>(literals, 15) << 4) | std::min<size_t>(matchNibble, 15));
+            if (literals >= 15)
+                writeLength(literals - 15);
+            memcpy(out, data + literalsStart, literals);
+            out += literals;
+            if (matchLength == 0)
+                return;
+            *out++ = static_cast<char>(offset & 0xff);
+            *out++ = static_cast<char>(offset >> 8);
+            if (matchNibble >= 15)
+                writeLength(matchNibble - 15);
+        };
+        size_t anchor = 0;
+        size_t i = 0;
+        size_t misses = 0;
+        while (size >= LAST_LITERALS + MIN_MATCH && i <= size - LAST_LITERALS - MIN_MATCH) {
+            uint32_t sequence = read32(i);
+            uint32_t & entry = table[(sequence * 2654435761u) >> (32 - HASH_BITS)];
+            size_t candidate = entry;
+            entry = static_cast<uint32_t>(i);
+            if (candidate < i && i - candidate <= MAX_OFFSET && read32(candidate) == sequence) {
+                size_t length = MIN_MATCH;
+                while (i + length < size - LAST_LITERALS && src[candidate + length] == src[i + length])
+                    ++length;
+                writeSequence(anchor, i - anchor, i - candidate, length);
+                i += length;
+                anchor = i;
+                misses = 0;
+            } else {
+                i += 1 + (misses++ >> SKIP_TRIGGER);
+            }
+        }
+        writeSequence(anchor, size - anchor, 0, 0);
+        into.resize(static_cast<size_t>(out - into.data()));
+    }
+
+    /** Decompresses data compressed by LZCompress() into a buffer of the decompressed size.
+     */
+    inline void LZDecompress(char const * data, size_t size, char * into, size_t decompressedSize) {
+        MARK_AS_UNUSED(decompressedSize);
+        unsigned char const * i = pointer_cast<unsigned char const *>(data);
+        unsigned char const * end = i + size;
+        size_t out = 0;
+        auto readLength = [&](size_t length) {
+            if (length == 15) {
+                unsigned char x;
+                do {
+                    ASSERT(i < end);
+                    x = *i++;
+                    length += x;
+                } while (x == 255);
+            }
+            return length;
+        };
+        while (i < end) {
+            unsigned char token = *i++;
+            size_t literals = readLength(token >> 4);
+            ASSERT(static_cast<size_t>(end - i) >= literals && out + literals <= decompressedSize);
+            memcpy(into + out, i, literals);
+            i += literals;
+            out += literals;
+            if (i == end)
+                break;
+            ASSERT(end - i >= 2);
+            size_t offset = i[0] | (static_cast<size_t>(i[1]) << 8);
+            i += 2;
+            size_t length = readLength(token & 0xf) + 4;
+            ASSERT(offset > 0 && offset <= out && out + length <= decompressedSize);
+            // the match may overlap the output, copy byte by byte
+            for (char const * from = into + out - offset, * e = into + out + length; into + out < e; ++out, ++from)
+                into[out] = *from;
+        }
+        ASSERT(out == decompressedSize);
+    }
+
+HELPERS_NAMESPACE_END
@@ -29,6 +29,11 @@ HELPERS_NAMESPACE_BEGIN
                 sender_{nullptr} {
             } 
 
+            explicit Payload(PAYLOAD && payload):
+                payload_{std::move(payload)},
+                sender_{nullptr} {
+            } 
+
             template<typename... ARGS>
             explicit Payload(ARGS... args):
                 payload_{PAYLOAD{args...}},
@@ -17,6 +17,7 @@
 #include <fstream>
 #include <iostream>
 #include <chrono>
+#include <atomic>
 #include <mutex>
 #include <iomanip>
 #include <vector>
@@ -263,6 +264,8 @@ HELPERS_NAMESPACE_END
 
 HELPERS_NAMESPACE_BEGIN
 
+    template<bool ENABLED>
+    class StaticLog;
 
     class Log {
 	public:
@@ -306,9 +309,12 @@ HELPERS_NAMESPACE_BEGIN
 				return time_;
 			}
 
+			/** Appends to the message, unless the log was disabled before the message was created.
+			 */
 			template<typename T>
 			Message & operator << (T const & what) {
-				(*s_) << what;
+				if (s_ != nullptr)
+				    (*s_) << what;
 				return *this;
 			}
 
@@ -319,6 +325,7 @@ HELPERS_NAMESPACE_BEGIN
 				file_(from.file_),
 				line_(from.line_),
 				time_(from.time_),
+				writer_(from.writer_),
 				s_(from.s_) {
 				from.log_ = nullptr;
 			}
@@ -337,6 +344,8 @@ HELPERS_NAMESPACE_BEGIN
 			char const * const file_;
 			size_t const line_;
 			std::time_t time_ = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+			/** The writer is loaded only once, so that the message is ended by the writer that began it even if the log is disabled, or its writer changed, in the meantime. */
+			Writer * writer_;
 			std::ostream * s_ = nullptr;
 
 		}; // Log::Message
@@ -354,8 +363,9 @@ HELPERS_NAMESPACE_BEGIN
 		}
 
 		Writer & writer() const {
-			ASSERT(writer_ != nullptr) << "Cannot get writer for disabled log";
-			return *writer_;
+			Writer * writer = writer_.load();
+			ASSERT(writer != nullptr) << "Cannot get writer for disabled log";
+			return *writer;
 		}
 
 		void enable(Writer & writer) {
@@ -364,10 +374,10 @@ HELPERS_NAMESPACE_BEGIN
 
 		/** Determines whether the log is enabled, or not. 
 		 
-		    Logging to a disabled log has no effect and negligible performance overhead of checking this flag.
+		    Logging to a disabled log has no effect and negligible performance overhead of checking this flag, which is a single relaxed atomic load so that logs can be enabled and disabled while other threads log.
 		 */
 		bool enabled() const {
-			return writer_ != nullptr;
+			return writer_.load(std::memory_order_relaxed) != nullptr;
 		}
 
 		/** Disables the log by clearing its writer. 
@@ -377,9 +387,10 @@ HELPERS_NAMESPACE_BEGIN
 		}
 
 		/** Creates new message for the log. 
+
+		    If the log has been disabled since it was checked, the message is ignored.
 		 */
 		Message createMessage(char const * file, size_t line) {
-			ASSERT(writer_ != nullptr) << "Cannot create message for disabled log";
 			return Message(this, file, line);
 		}
 
@@ -434,6 +445,11 @@ HELPERS_NAMESPACE_BEGIN
 			return log;
 		}
 
+        template<bool ENABLED>
+        static StaticLog<ENABLED> & GetLog(StaticLog<ENABLED> & log) {
+            return log;
+        }
+
         static Log & GetLog(std::function<Log &()> log) {
             return log();
         }
@@ -450,7 +466,7 @@ HELPERS_NAMESPACE_BEGIN
 
 	    std::string name_;
 
-		Writer * writer_ = nullptr;
+		std::atomic<Writer *> writer_{nullptr};
 
 		static std::unordered_map<std::string, Log *> & RegisteredLogs() {
 			static std::unordered_map<std::string, Log *> logs;
@@ -458,6 +474,22 @@ HELPERS_NAMESPACE_BEGIN
 		}
 	};
 
+    /** Log that can be compiled out. 
+     
+        When ENABLED is false, enabled() is a constant expression and any LOG statements for the log are eliminated by the compiler entirely, including the evaluation of their arguments. This is intended for logs on hot paths, such as tracing of every parsed character, that should cost nothing unless explicitly compiled in for diagnostics. The log is still registered, but enabling it has no effect. 
+     */
+    template<bool ENABLED>
+    class StaticLog : public Log {
+    public:
+        explicit StaticLog(std::string const & name):
+            Log{name} {
+        }
+
+        bool enabled() const {
+            return ENABLED && Log::enabled();
+        }
+    }; // StaticLog
+
     /** A simple std::ostream based log message writer. 
      
         Writes all log messages into the given stream, allows to specify what parts of the message are to be printed, such as the location in the source, timestamp and logname. 
@@ -560,13 +592,15 @@ HELPERS_NAMESPACE_BEGIN
 	inline Log::Message::Message(Log * log, char const * file, size_t line):
 	    log_{log},
 		file_{file},
-		line_{line} {
-			s_ = & log_->writer_->beginMessage(*this);
+		line_{line},
+		writer_{log->writer_.load()} {
+		if (writer_ != nullptr)
+			s_ = & writer_->beginMessage(*this);
 	}
 
 	inline Log::Message::~Message() {
-		if (log_ != nullptr)
-		    log_->writer_->endMessage(*this);
+		if (log_ != nullptr && writer_ != nullptr)
+		    writer_->endMessage(*this);
 	}
 
 	/** Creates new log. 
@@ -51,6 +51,14 @@ HELPERS_NAMESPACE_BEGIN
             m_.unlock();
         }
 
+        /** Returns true if there are threads waiting for the lock in priority mode. 
+         
+            Holders of the lock in normal mode can use this to release the lock early. 
+         */
+        bool priorityRequested() const {
+            return priorityRequests_ > 0;
+        }
+
 #ifndef NDEBUG
         bool locked() const {
             return locked_ == std::this_thread::get_id();
@@ -0,0 +1,162 @@
+#pragma once
+#if (defined ARCH_WINDOWS)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+#include "helpers.h"
+#include "string.h"
+
+HELPERS_NAMESPACE_BEGIN
+
+    /** Temporary file mapped in memory, which grows as data are appended to it.
+
+        The file is created when the object is constructed and deleted when it is destroyed. Its lifetime is tied to the process, so the file does not outlive a crash either: on Windows it is opened with the delete on close flag and on other systems it is unlinked straight away and only the open descriptor keeps it alive.
+
+        The file grows by doubling its mapped capacity, so the pointer returned by data() is only valid until the file grows by the next append() or resize().
+     */
+    class MappedFile {
+    public:
+
+        /** Minimal capacity of the file once anything is appended.
+         */
+        static constexpr size_t MIN_CAPACITY = 1024 * 1024;
+
+        /** Creates the file of given name, which must not exist, throws OSError on failure.
+         */
+        explicit MappedFile(std::string const & filename):
+            filename_{filename} {
+#if (defined ARCH_WINDOWS)
+            file_ = CreateFileW(UTF8toUTF16(filename).c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_NEW, FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, nullptr);
+            OSCHECK(file_ != INVALID_HANDLE_VALUE) << "Unable to create file " << filename;
+#else
+            fd_ = open(filename.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+            OSCHECK(fd_ != -1) << "Unable to create file " << filename;
+            unlink(filename.c_str());
+#endif
+        }
+
+        MappedFile(MappedFile const &) = delete;
+        MappedFile & operator = (MappedFile const &) = delete;
+
+        ~MappedFile() {
+            unmap();
+#if (defined ARCH_WINDOWS)
+            CloseHandle(file_);
+#else
+            close(fd_);
+#endif
+        }
+
+        std::string const & filename() const {
+            return filename_;
+        }
+
+        /** Returns the number of bytes appended to the file.
+         */
+        size_t size() const {
+            return size_;
+        }
+
+        /** Returns the number of bytes the file occupies, which is the capacity of its mapping.
+         */
+        size_t capacity() const {
+            return capacity_;
+        }
+
+        char const * data() const {
+            return data_;
+        }
+
+        char * data() {
+            return data_;
+        }
+
+        /** Appends the data at the end of the file and returns the offset at which they were written.
+         */
+        size_t append(char const * data, size_t size) {
+            if (size_ + size > capacity_)
+                remap(std::max(std::max(capacity_ * 2, size_ + size), MIN_CAPACITY));
+            memcpy(data_ + size_, data, size);
+            size_t result = size_;
+            size_ += size;
+            return result;
+        }
+
+        /** Changes the number of bytes in the file, growing the file if necessary.
+
+            The contents of the bytes over the previous size are unspecified. Shrinking the file keeps its capacity.
+         */
+        void resize(size_t size) {
+            if (size > capacity_)
+                remap(std::max(std::max(capacity_ * 2, size), MIN_CAPACITY));
+            size_ = size;
+        }
+
+        /** Removes everything from the file and shrinks it.
+         */
+        void clear() {
+            unmap();
+#if (defined ARCH_WINDOWS)
+            SetFilePointer(file_, 0, nullptr, FILE_BEGIN);
+            SetEndOfFile(file_);
+#else
+            OSCHECK(ftruncate(fd_, 0) == 0) << "Unable to truncate file " << filename_;
+#endif
+            size_ = 0;
+        }
+
+    private:
+
+        void remap(size_t capacity) {
+            unmap();
+#if (defined ARCH_WINDOWS)
+            // creating the mapping grows the file
+            mapping_ = CreateFileMappingW(file_, nullptr, PAGE_READWRITE, static_cast<DWORD>(static_cast<uint64_t>(capacity) >> 32), static_cast<DWORD>(capacity), nullptr);
+            OSCHECK(mapping_ != nullptr) << "Unable to map file " << filename_;
+            data_ = static_cast<char *>(MapViewOfFile(mapping_, FILE_MAP_ALL_ACCESS, 0, 0, capacity));
+            OSCHECK(data_ != nullptr) << "Unable to map file " << filename_;
+#else
+            OSCHECK(ftruncate(fd_, static_cast<off_t>(capacity)) == 0) << "Unable to grow file " << filename_;
+            void * data = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+            OSCHECK(data != MAP_FAILED) << "Unable to map file " << filename_;
+            data_ = static_cast<char *>(data);
+#endif
+            capacity_ = capacity;
+        }
+
+        void unmap() {
+            if (data_ == nullptr)
+                return;
+#if (defined ARCH_WINDOWS)
+            UnmapViewOfFile(data_);
+            CloseHandle(mapping_);
+            mapping_ = nullptr;
+#else
+            munmap(data_, capacity_);
+#endif
+            data_ = nullptr;
+            capacity_ = 0;
+        }
+
+        std::string filename_;
+#if (defined ARCH_WINDOWS)
+        HANDLE file_;
+        HANDLE mapping_ = nullptr;
+#else
+        int fd_;
+#endif
+        char * data_ = nullptr;
+        size_t size_ = 0;
+        size_t capacity_ = 0;
+
+    }; // MappedFile
+
+HELPERS_NAMESPACE_END
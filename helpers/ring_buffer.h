@@ -0,0 +1,141 @@
+#pragma once
+
+#include <algorithm>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+
+#include "helpers.h"
+
+HELPERS_NAMESPACE_BEGIN
+
+    /** Single producer, single consumer ring buffer of bytes.
+
+        The producer writes directly into the free space returned by reserve() and publishes the written bytes with commit(), the consumer reads the data available via peek() and releases them with consume(). The read and write positions are atomic so that neither side takes any lock while there is data, or free space respectively. The mutex and condition variable are only used to put a side to sleep when the buffer is empty, or full.
+
+        A full buffer blocks the producer, which provides backpressure to whatever it reads from.
+     */
+    class RingBuffer {
+    public:
+
+        explicit RingBuffer(size_t capacity):
+            data_{new char[capacity]},
+            capacity_{capacity},
+            writePos_{0},
+            readPos_{0},
+            maxSize_{0},
+            producerWaiting_{false},
+            consumerWaiting_{false},
+            closed_{false} {
+            ASSERT(capacity > 0);
+        }
+
+        ~RingBuffer() {
+            delete [] data_;
+        }
+
+        size_t capacity() const {
+            return capacity_;
+        }
+
+        /** Returns the number of bytes written, but not yet consumed.
+         */
+        size_t size() const {
+            return writePos_.load() - readPos_.load();
+        }
+
+        /** Returns the largest size the buffer had so far.
+         */
+        size_t maxSize() const {
+            return maxSize_.load();
+        }
+
+        /** Returns contiguous free space of at most maxSize bytes, blocking while the buffer is full.
+         */
+        size_t reserve(char * & buffer, size_t maxSize) {
+            size_t writePos = writePos_.load(std::memory_order_relaxed);
+            if (writePos - readPos_.load() == capacity_) {
+                std::unique_lock<std::mutex> g{m_};
+                producerWaiting_ = true;
+                cv_.wait(g, [&](){ return writePos - readPos_.load() != capacity_; });
+                producerWaiting_ = false;
+            }
+            size_t offset = writePos % capacity_;
+            buffer = data_ + offset;
+            return std::min(std::min(capacity_ - (writePos - readPos_.load()), capacity_ - offset), maxSize);
+        }
+
+        /** Publishes given number of bytes written to the reserved space.
+         */
+        void commit(size_t size) {
+            size_t writePos = writePos_.load(std::memory_order_relaxed) + size;
+            writePos_.store(writePos);
+            size_t current = writePos - readPos_.load();
+            if (current > maxSize_.load(std::memory_order_relaxed))
+                maxSize_.store(current, std::memory_order_relaxed);
+            if (consumerWaiting_.load())
+                notify();
+        }
+
+        /** Signals that no more data will be written.
+
+            Once the remaining data are consumed, peek() returns 0.
+         */
+        void close() {
+            closed_ = true;
+            notify();
+        }
+
+        /** Returns the contiguous data available, blocking while the buffer is empty.
+
+            Returns 0 if the buffer is empty and has been closed.
+         */
+        size_t peek(char const * & buffer) {
+            size_t readPos = readPos_.load(std::memory_order_relaxed);
+            if (writePos_.load() == readPos) {
+                std::unique_lock<std::mutex> g{m_};
+                consumerWaiting_ = true;
+                cv_.wait(g, [&](){ return writePos_.load() != readPos || closed_; });
+                consumerWaiting_ = false;
+            }
+            size_t offset = readPos % capacity_;
+            buffer = data_ + offset;
+            return std::min(writePos_.load() - readPos, capacity_ - offset);
+        }
+
+        /** Releases given number of bytes at the read position.
+         */
+        void consume(size_t size) {
+            readPos_.store(readPos_.load(std::memory_order_relaxed) + size);
+            if (producerWaiting_.load())
+                notify();
+        }
+
+    private:
+
+        /** Wakes up the other side.
+
+            The mutex must be acquired so that the notification can't arrive between the waiting side checking its condition and going to sleep.
+         */
+        void notify() {
+            {
+                std::lock_guard<std::mutex> g{m_};
+            }
+            cv_.notify_all();
+        }
+
+        char * data_;
+        size_t capacity_;
+        /** Total number of bytes written and read, the positions in the buffer are their remainders. */
+        std::atomic<size_t> writePos_;
+        std::atomic<size_t> readPos_;
+        std::atomic<size_t> maxSize_;
+        std::atomic<bool> producerWaiting_;
+        std::atomic<bool> consumerWaiting_;
+        std::atomic<bool> closed_;
+        std::mutex m_;
+        std::condition_variable cv_;
+
+    }; // RingBuffer
+
+HELPERS_NAMESPACE_END
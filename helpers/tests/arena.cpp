@@ -0,0 +1,54 @@
+#include "helpers/tests.h"
+
+#include "helpers/arena.h"
+
+TEST(helpers_arena, fifo) {
+    FifoArena<int> arena{8};
+    int * a = arena.allocate(5);
+    int * b = arena.allocate(3);
+    EXPECT(b == a + 5);
+    EXPECT_EQ(arena.chunks(), 1u);
+    // does not fit in the rest of the chunk
+    int * c = arena.allocate(2);
+    EXPECT_EQ(arena.chunks(), 2u);
+    // runs can be freed in parts
+    arena.free(a, 2);
+    arena.free(a + 2, 3);
+    arena.free(b, 3);
+    EXPECT_EQ(arena.chunks(), 1u);
+    // the freed chunk is reused
+    int * d = arena.allocate(7);
+    EXPECT(d == a);
+    // runs larger than chunk size get their own chunk
+    int * e = arena.allocate(20);
+    EXPECT_EQ(arena.chunks(), 3u);
+    arena.free(c, 2);
+    arena.free(d, 7);
+    arena.free(e, 20);
+    EXPECT_EQ(arena.chunks(), 1u);
+    // the last chunk is reused from its start when empty
+    EXPECT(arena.allocate(1) == e);
+}
+
+TEST(helpers_arena, extend) {
+    FifoArena<int> arena{8};
+    int * a = arena.allocate(2);
+    int * b = arena.allocate(3);
+    b[0] = 1;
+    // grows in place while the run fits in its chunk
+    EXPECT(arena.extend(b, 3, 2) == b);
+    // moves to a new chunk, leaving the older run in place
+    int * c = arena.extend(b, 5, 4);
+    EXPECT_EQ(arena.chunks(), 2u);
+    EXPECT_EQ(c[0], 1);
+    arena.free(a, 2);
+    EXPECT_EQ(arena.chunks(), 1u);
+    // a run that was alone in its chunk releases the chunk when moved
+    int * d = arena.extend(c, 9, 10);
+    EXPECT_EQ(arena.chunks(), 1u);
+    EXPECT_EQ(d[0], 1);
+    // the oversized chunk has room to grow
+    EXPECT(arena.extend(d, 19, 19) == d);
+    arena.free(d, 38);
+    EXPECT_EQ(arena.chunks(), 1u);
+}
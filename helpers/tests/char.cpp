@@ -0,0 +1,40 @@
+#include "helpers/tests.h"
+
+#include "helpers/char.h"
+
+TEST(helpers_char, findNonPrintableASCII) {
+    std::string s{"Hello world, this is a longer line of plain text."};
+    EXPECT_EQ(FindNonPrintableASCII(s.c_str(), s.c_str() + s.size()) - s.c_str(), static_cast<long>(s.size()));
+    EXPECT_EQ(FindNonPrintableASCII(s.c_str(), s.c_str()) - s.c_str(), 0);
+}
+
+TEST(helpers_char, findNonPrintableASCIIControl) {
+    std::string s{"0123456789abcdefghijklmnopqrstuvwxyz"};
+    for (size_t i = 0; i < s.size(); ++i) {
+        for (char c : { '\033', '\n', '\x7f', '\x01' }) {
+            std::string x{s};
+            x[i] = c;
+            EXPECT_EQ(FindNonPrintableASCII(x.c_str(), x.c_str() + x.size()) - x.c_str(), static_cast<long>(i));
+        }
+    }
+}
+
+TEST(helpers_char, findNonPrintableASCIIUTF8) {
+    std::string s{"abcdefghijklmnopqrstuvwxyz \xc4\x8d"};
+    EXPECT_EQ(FindNonPrintableASCII(s.c_str(), s.c_str() + s.size()) - s.c_str(), 27);
+}
+
+TEST(helpers_char, columnWidth) {
+    EXPECT_EQ(Char::ColumnWidth('a'), 1);
+    EXPECT_EQ(Char::ColumnWidth(0xe9), 1); // e acute
+    EXPECT_EQ(Char::ColumnWidth(0x301), 0); // combining acute accent
+    EXPECT_EQ(Char::ColumnWidth(0x200d), 0); // zero width joiner
+    EXPECT_EQ(Char::ColumnWidth(0xfe0f), 0); // variation selector 16
+    EXPECT_EQ(Char::ColumnWidth(0x4e2d), 2); // CJK ideograph
+    EXPECT_EQ(Char::ColumnWidth(0xac00), 2); // Hangul syllable
+    EXPECT_EQ(Char::ColumnWidth(0x1f600), 2); // emoji
+    EXPECT_EQ(Char::ColumnWidth(0x2603), 1); // snowman, text presentation by default
+    EXPECT_EQ(Char::ColumnWidth(0x3fffd), 2); // unassigned, but wide by default
+    EXPECT_EQ(Char::ColumnWidth(0x10ffff), 1);
+    EXPECT_EQ(Char::ColumnWidth(0x110000), 1);
+}
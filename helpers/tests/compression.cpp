@@ -0,0 +1,37 @@
+#include "helpers/tests.h"
+
+#include "helpers/compression.h"
+
+namespace {
+
+    std::string RoundTrip(std::string const & data, size_t & compressedSize) {
+        std::string compressed;
+        LZCompress(data.c_str(), data.size(), compressed);
+        compressedSize = compressed.size();
+        std::string result(data.size(), '\0');
+        LZDecompress(compressed.c_str(), compressed.size(), result.data(), result.size());
+        return result;
+    }
+
+}
+
+TEST(helpers_compression, lz) {
+    size_t compressedSize;
+    for (std::string data : { std::string{}, std::string{"abc"}, std::string{"abcdefgh"}, std::string{"aaaaaaaaaaaaaaaaaaaa"} })
+        EXPECT_EQ(RoundTrip(data, compressedSize), data);
+    // repetitive data compresses well, including long literals and matches
+    std::string data;
+    for (int i = 0; i < 1000; ++i)
+        data += "line " + std::to_string(i % 50) + " of some log output\n";
+    EXPECT_EQ(RoundTrip(data, compressedSize), data);
+    EXPECT(compressedSize < data.size() / 10);
+    // random data does not
+    data.clear();
+    uint32_t x = 1;
+    for (int i = 0; i < 10000; ++i) {
+        x = x * 1103515245 + 12345;
+        data.push_back(static_cast<char>(x >> 16));
+    }
+    EXPECT_EQ(RoundTrip(data, compressedSize), data);
+    EXPECT(compressedSize > data.size());
+}
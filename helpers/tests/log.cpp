@@ -0,0 +1,22 @@
+#include <sstream>
+
+#include "helpers/tests.h"
+
+#include "helpers/helpers.h"
+
+TEST(helpers_log, disabledWhileLogging) {
+    Log log{"test-disabled-while-logging"};
+    std::stringstream s;
+    Log::OStreamWriter writer{s, false, false, false};
+    log.enable(writer);
+    {
+        auto message = log.createMessage(__FILE__, __LINE__);
+        // the message is still ended by the writer it was begun with
+        log.disable();
+        message << "foo";
+    }
+    EXPECT_EQ(s.str(), "foo\n");
+    // a message created after the log was disabled, such as when disabled by another thread after enabled() was checked, is ignored
+    log.createMessage(__FILE__, __LINE__) << "bar";
+    EXPECT_EQ(s.str(), "foo\n");
+}
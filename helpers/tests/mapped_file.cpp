@@ -0,0 +1,29 @@
+#include "helpers/tests.h"
+
+#include "helpers/filesystem.h"
+#include "helpers/mapped_file.h"
+
+TEST(helpers_mapped_file, appendAndResize) {
+    std::string filename = MakeUnique(JoinPath(TempDir(), "tpp-test-mapped"));
+    {
+        MappedFile f{filename};
+        EXPECT_EQ(f.size(), 0u);
+        EXPECT_EQ(f.append("hello", 5), 0u);
+        EXPECT_EQ(f.capacity(), MappedFile::MIN_CAPACITY);
+        // grows over the capacity
+        std::string large(MappedFile::MIN_CAPACITY, 'x');
+        EXPECT_EQ(f.append(large.c_str(), large.size()), 5u);
+        EXPECT_EQ(f.capacity(), MappedFile::MIN_CAPACITY * 2);
+        EXPECT_EQ(std::string(f.data(), 5), "hello");
+        f.resize(3);
+        EXPECT_EQ(f.size(), 3u);
+        EXPECT_EQ(f.capacity(), MappedFile::MIN_CAPACITY * 2);
+        EXPECT_EQ(f.append("p", 1), 3u);
+        EXPECT_EQ(std::string(f.data(), 4), "help");
+        f.clear();
+        EXPECT_EQ(f.size(), 0u);
+        EXPECT_EQ(f.append("abc", 3), 0u);
+        EXPECT_EQ(std::string(f.data(), 3), "abc");
+    }
+    EXPECT(! PathExists(filename));
+}
@@ -0,0 +1,64 @@
+#include <thread>
+
+#include "helpers/tests.h"
+
+#include "helpers/ring_buffer.h"
+
+TEST(helpers_ring_buffer, singleThread) {
+    RingBuffer rb{8};
+    char * w;
+    EXPECT_EQ(rb.reserve(w, 100), 8u);
+    memcpy(w, "abcdef", 6);
+    rb.commit(6);
+    EXPECT_EQ(rb.size(), 6u);
+    char const * r;
+    EXPECT_EQ(rb.peek(r), 6u);
+    EXPECT_EQ(std::string(r, 4), "abcd");
+    rb.consume(4);
+    // the free space is contiguous only up to the end of the buffer
+    EXPECT_EQ(rb.reserve(w, 100), 2u);
+    memcpy(w, "gh", 2);
+    rb.commit(2);
+    EXPECT_EQ(rb.reserve(w, 100), 4u);
+    EXPECT_EQ(rb.peek(r), 4u);
+    EXPECT_EQ(std::string(r, 4), "efgh");
+    rb.consume(4);
+    EXPECT_EQ(rb.size(), 0u);
+    EXPECT_EQ(rb.maxSize(), 6u);
+    rb.close();
+    EXPECT_EQ(rb.peek(r), 0u);
+}
+
+TEST(helpers_ring_buffer, producerConsumer) {
+    RingBuffer rb{7};
+    size_t const total = 100000;
+    std::thread producer{[&](){
+        size_t i = 0;
+        while (i < total) {
+            char * w;
+            size_t n = rb.reserve(w, 1 + i % 5);
+            n = std::min(n, total - i);
+            for (size_t j = 0; j < n; ++j)
+                w[j] = static_cast<char>((i + j) % 251);
+            rb.commit(n);
+            i += n;
+        }
+        rb.close();
+    }};
+    size_t received = 0;
+    bool ok = true;
+    while (true) {
+        char const * r;
+        size_t n = rb.peek(r);
+        if (n == 0)
+            break;
+        for (size_t j = 0; j < n; ++j)
+            ok = ok && (r[j] == static_cast<char>((received + j) % 251));
+        received += n;
+        rb.consume(n);
+    }
+    producer.join();
+    EXPECT(ok);
+    EXPECT_EQ(received, total);
+    EXPECT(rb.maxSize() <= rb.capacity());
+}
@@ -0,0 +1,17 @@
+/* AUTOGENERATED FILE, DO NOT EDIT! 
+   This file was produced by the following command:
+  /tmp/warn_build/stamp-generator /root/repo/stamp.h
+ */
+#pragma once
+#include<string_view>
+namespace stamp {
+    std::string_view constexpr version               = "0.8.4";
+    std::string_view constexpr arch                  = "Linux";
+    std::string_view constexpr arch_size             = "64";
+    std::string_view constexpr arch_compiler         = "GNU";
+    std::string_view constexpr arch_compiler_version = "12.2.0";
+    std::string_view constexpr build                 = "release";
+    std::string_view constexpr build_time            = "2026-10-17T04:57:15Z";
+    std::string_view constexpr commit                = "a0542a3538bda177b8623d8eb74a25d59c39ca80";
+    bool             constexpr dirty                 = true;
+} // namespace stamp
@@ -156,6 +156,10 @@ namespace tpp {
 		return JSON{JoinPath(JoinPath(TempDir(), "terminalpp"),"remoteFiles")};
 	}
 
+	JSON Config::DefaultHistoryDir() {
+		return JSON{JoinPath(JoinPath(TempDir(), "terminalpp"),"history")};
+	}
+
 	JSON Config::DefaultFontFamily() {
 #if (defined ARCH_WINDOWS)
 		return JSON{"Consolas"};
@@ -270,6 +270,12 @@ namespace tpp {
                 JSON::Array(),
                 std::vector<std::reference_wrapper<Log>>
             );
+            CONFIG_PROPERTY(
+                recordSessions,
+                "If true, the output of every session is recorded with its timing to the telemetry directory so that it can be replayed later, e.g. by the tpp-bench benchmark",
+                JSON{false},
+                bool
+            );
         );
         CONFIG_OBJECT(
             renderer,
@@ -465,6 +471,18 @@ namespace tpp {
                 JSON{true},
                 bool
             );
+            CONFIG_PROPERTY(
+                parserSliceSize,
+                "Maximum number of bytes the terminal parses before it lets the user interface access the terminal buffer. Smaller values improve responsiveness when large amounts of output are received, larger values improve throughput.",
+                JSON{16384},
+                unsigned
+            );
+            CONFIG_PROPERTY(
+                jumpScrollThreshold,
+                "Number of bytes received between two frames above which the terminal jump scrolls, i.e. displays only the states at frame boundaries while it is flooded with output. 0 disables jump scrolling.",
+                JSON{65536},
+                unsigned
+            );
         );
         CONFIG_OBJECT(
             remoteFiles,
@@ -476,6 +494,34 @@ namespace tpp {
                 std::string
             );
         );
+        CONFIG_OBJECT(
+            history,
+            "Settings for the history of the sessions kept on disk and the memory the sessions may occupy.",
+            CONFIG_PROPERTY(
+                dir,
+                "Directory in which the sessions keep the part of their history that does not fit in memory. Each session has its own file, which is deleted when the session is closed.",
+                DefaultHistoryDir,
+                std::string
+            );
+            CONFIG_PROPERTY(
+                memoryLimit,
+                "Kilobytes of compressed history each session keeps in memory, older history is moved to a file in the history directory. If set to 0, the whole history is kept in memory. Together with a large history limit, this provides effectively unlimited history.",
+                JSON{0},
+                unsigned
+            );
+            CONFIG_PROPERTY(
+                sessionMemoryLimit,
+                "Kilobytes of memory each session may occupy with its history, buffers and hyperlinks. The oldest lines of the history are deleted when the session does not fit. If set to 0, only the history limit applies.",
+                JSON{0},
+                unsigned
+            );
+            CONFIG_PROPERTY(
+                windowMemoryLimit,
+                "Kilobytes of memory all sessions of a window may occupy together. The session adding lines to its history deletes its oldest lines when the sessions do not fit. If set to 0, the sessions are not limited together.",
+                JSON{0},
+                unsigned
+            );
+        );
         CONFIG_OBJECT(
             sessionDefaults,
             "Default values for session properties. These will be used when a session does not override the values",
@@ -793,6 +839,8 @@ namespace tpp {
 
 		static JSON DefaultRemoteFilesDir();
 
+		static JSON DefaultHistoryDir();
+
 		static JSON DefaultFontFamily();
 
 		static JSON DefaultDoubleWidthFontFamily();
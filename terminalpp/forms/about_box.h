@@ -8,10 +8,13 @@ namespace tpp {
 
     class AboutBox : public ui::Dialog::Cancel {
     public:
-        AboutBox():
+        /** Creates the about box, showing given information about the memory used by the sessions.
+         */
+        explicit AboutBox(std::string const & memoryInfo):
             Cancel{"Terminal++"},
             btnNewIssue_{new Button{" new issue "}},
-            btnWWW_{new Button{" www "}} {
+            btnWWW_{new Button{" www "}},
+            memoryInfo_{memoryInfo} {
             setWidthHint(SizeHint::Manual());
             setHeightHint(SizeHint::Manual());
             //setSemanticStyle(SemanticStyle::Primary);
@@ -45,6 +48,7 @@ namespace tpp {
                 canvas.textOut(Point{13,3}, STR(stamp::commit << (stamp::dirty ? "*" : "")));
                 //canvas.textOut(Point{13,4}, stamp::build_time);
             }
+            canvas.textOut(Point{3, 5}, memoryInfo_);
 #if (defined RENDERER_QT)
             canvas.textOut(Point{3, 6}, STR("platform: " << ARCH << "(Qt) " << ARCH_SIZE << " " << ARCH_COMPILER << " " << ARCH_COMPILER_VERSION << " " << stamp::build));
 #else
@@ -64,6 +68,7 @@ namespace tpp {
 
         Button * btnNewIssue_;
         Button * btnWWW_;
+        std::string memoryInfo_;
 
     }; // tpp::AboutBox
 
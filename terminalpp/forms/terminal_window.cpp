@@ -1,3 +1,5 @@
+#include "helpers/filesystem.h"
+
 #include "terminal_window.h"
 
 
@@ -21,14 +23,36 @@ namespace tpp {
 #else
         pty = new LocalPTYMaster{cmd};
 #endif
+        // create the recorder, if enabled, a session which can't be recorded still opens, the error has been logged already
+        PTYRecorder * recorder = nullptr;
+        if (config.telemetry.recordSessions()) {
+            static std::atomic<unsigned> recordings{0};
+            try {
+                recorder = new PTYRecorder{STR(config.telemetry.dir() << "/" << TimeInDashed() << "-" << recordings++ << ".tpprec")};
+            } catch (IOError const &) {
+            }
+        }
         // and the terminal
-        si->terminal = new AnsiTerminal{pty, session.palette()};
+        si->terminal = new AnsiTerminal{pty, session.palette(), recorder};
         si->terminal->setMaxHistoryRows(config.renderer.window.historyLimit());
+        si->terminal->setMemoryLimit(static_cast<size_t>(config.history.sessionMemoryLimit()) * 1024);
+        si->terminal->setMemoryBudget(& memoryBudget_);
+        // a session whose history file can't be created keeps all its history in memory
+        if (config.history.memoryLimit() != 0) {
+            try {
+                CreatePath(config.history.dir());
+                si->terminal->setHistoryFile(MakeUnique(JoinPath(config.history.dir(), TimeInDashed()), "-"), static_cast<size_t>(config.history.memoryLimit()) * 1024);
+            } catch (std::exception const & e) {
+                LOG() << "Unable to create history file: " << e.what();
+            }
+        }
         si->terminal->setBoldIsBright(config.sequences.boldIsBright());
         si->terminal->setDisplayBold(config.sequences.displayBold());
         si->terminal->setCursor(session.cursor());
         si->terminal->setInactiveCursorColor(session.cursor.inactiveColor());
         si->terminal->setAllowCursorChanges(config.sequences.allowCursorChanges());
+        si->terminal->setParserSliceSize(std::max(config.sequences.parserSliceSize(), 1u));
+        si->terminal->setJumpScrollThreshold(config.sequences.jumpScrollThreshold());
         si->terminal->setAllowOSCHyperlinks(config.sequences.allowOSCHyperlinks());
         si->terminal->setDetectHyperlinks(config.sequences.detectHyperlinks());
         si->terminal->setNormalHyperlinkStyle(config.renderer.hyperlinks.normal());
@@ -98,7 +98,8 @@ namespace tpp {
         explicit TerminalWindow(tpp::Window * window):
             window_{window},
             main_{new Panel{}},
-            pager_{new Pager{}} {
+            pager_{new Pager{}},
+            memoryBudget_{static_cast<size_t>(Config::Instance().history.windowMemoryLimit()) * 1024} {
 
             window_->onClose.setHandler(&TerminalWindow::windowCloseRequest, this);
             window_->onKeyDown.setHandler(&TerminalWindow::windowKeyDown, this);
@@ -134,6 +135,9 @@ namespace tpp {
 
         ~TerminalWindow() override {
             versionChecker_.join();
+            // the terminals may outlive the window's budget
+            for (auto & i : sessions_)
+                i.first->setMemoryBudget(nullptr);
             delete remoteFiles_;
         }
 
@@ -193,13 +197,30 @@ namespace tpp {
                 if (window_->zoom() > 1)
                     window_->setZoom(std::max(1.0, window_->zoom() / 1.25));
             } else if (*e == SHORTCUT_ABOUT && ! window_->isModal()) {
-                showModal(new AboutBox{});
+                showModal(new AboutBox{memoryInfo()});
             } else {
                 return;
             }
             e.stop();
         }
 
+        /** Returns the memory occupied by the active session and by all sessions of the window.
+         */
+        std::string memoryInfo() {
+            if (activeSession_ == nullptr)
+                return std::string{};
+            AnsiTerminal::MemoryUsage usage = activeSession_->terminal->memoryUsage();
+            std::stringstream s;
+            s << "memory:   " << usage.total() / 1024 << "KB";
+            if (usage.historyFile != 0)
+                s << " (+" << usage.historyFile / 1024 << "KB file)";
+            s << ", window " << memoryBudget_.used() / 1024;
+            if (memoryBudget_.limit() != 0)
+                s << "/" << memoryBudget_.limit() / 1024;
+            s << "KB";
+            return s.str();
+        }
+
         SessionInfo * sessionInfo(Widget * terminal) {
             AnsiTerminal * t = dynamic_cast<AnsiTerminal*>(terminal);
             ASSERT(t != nullptr);
@@ -410,6 +431,9 @@ namespace tpp {
 
         RemoteFiles * remoteFiles_;
 
+        /** Memory shared by all sessions of the window. */
+        AnsiTerminal::MemoryBudget memoryBudget_;
+
         std::thread versionChecker_;
 
     };
@@ -393,7 +393,10 @@ namespace tpp {
                     }
                     // we don't care about the border at this stage
                     // draw the cell
-                    addGlyph(col, row, c);
+                    if (! c.isGrapheme())
+                        addGlyph(col, row, c);
+                    else
+                        drawGrapheme(col, row, c, buffer.graphemes()[c.graphemeId()]);
                     // move to the next column (skip invisible cols if double width or larger font)
                     col += c.font().width();
                 }
@@ -437,6 +440,31 @@ namespace tpp {
             finalizeDraw();
         }
 
+        /** Draws a cell containing grapheme cluster. 
+         
+            The renderers do not shape text, so the base character of the cluster is drawn first and the zero width characters of the cluster, such as combining marks, are drawn over it with transparent background. Joiners and variation selectors have no glyphs of their own and characters joined to the base character are not drawn. 
+         */
+        void drawGrapheme(int col, int row, Cell const & c, std::u32string const & cluster) {
+            Cell glyph;
+            glyph.setCodepoint(cluster[0]);
+            addGlyph(col, row, glyph);
+            drawGlyphRun();
+            state_.setBg(Color::None);
+            changeBg(state_.bg());
+            for (size_t i = 1, e = cluster.size(); i < e; ++i) {
+                char32_t cp = cluster[i];
+                if (Char::ColumnWidth(cp) != 0 || cp == Char::ZWJ || (cp >= 0xfe00 && cp <= 0xfe0f))
+                    continue;
+                initializeGlyphRun(col, row);
+                glyph.setCodepoint(cp);
+                addGlyph(col, row, glyph);
+                drawGlyphRun();
+            }
+            state_.setBg(c.bg());
+            changeBg(state_.bg());
+            initializeGlyphRun(col + c.font().width(), row);
+        }
+
         #undef initializeDraw
         #undef initializeGlyphRun
         #undef addGlyph
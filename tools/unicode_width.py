@@ -0,0 +1,113 @@
+#!/usr/bin/env python3
+"""Generates helpers/char_width.h, the column widths of all unicode codepoints.
+
+Usage: unicode_width.py [EastAsianWidth.txt UnicodeData.txt] > helpers/char_width.h
+
+The widths are determined from the East Asian Width property and the general category of the codepoints. If the Unicode Character Database files are not given, the unicodedata module of the python interpreter is used, which may be an older unicode version.
+
+- combining marks (Mn, Me), format characters (Cf) except the soft hyphen, Hangul medial vowels and final consonants and the zero width space are 0 columns wide
+- wide (W) and fullwidth (F) characters, including emoji with default emoji presentation, are 2 columns wide, as are the unassigned codepoints in the CJK blocks which default to wide
+- everything else is 1 column wide
+
+Only the ranges of codepoints whose width is not 1 are emitted, the two-stage lookup table is built from them at compile time by Char::ColumnWidth.
+"""
+
+import sys
+import unicodedata
+
+MAX_CODEPOINT = 0x110000
+
+# unassigned codepoints in these ranges default to wide, see the header of EastAsianWidth.txt
+DEFAULT_WIDE = [(0x3400, 0x4dbf), (0x4e00, 0x9fff), (0xf900, 0xfaff), (0x20000, 0x2fffd), (0x30000, 0x3fffd)]
+
+def parseCodepoints(field):
+    field = field.strip()
+    if ".." in field:
+        first, last = field.split("..")
+        return int(first, 16), int(last, 16)
+    return int(field, 16), int(field, 16)
+
+def loadUCD(eastAsianWidthFile, unicodeDataFile):
+    eaw = ["N"] * MAX_CODEPOINT
+    category = ["Cn"] * MAX_CODEPOINT
+    version = "unknown"
+    with open(eastAsianWidthFile, encoding = "utf-8") as f:
+        for line in f:
+            if line.startswith("# EastAsianWidth-"):
+                version = line[len("# EastAsianWidth-"):].split(".txt")[0]
+            line = line.split("#")[0].strip()
+            if not line:
+                continue
+            codepoints, value = line.split(";")
+            first, last = parseCodepoints(codepoints)
+            for cp in range(first, last + 1):
+                eaw[cp] = value.strip()
+    with open(unicodeDataFile, encoding = "utf-8") as f:
+        rangeStart = None
+        for line in f:
+            fields = line.split(";")
+            cp = int(fields[0], 16)
+            if fields[1].endswith(", First>"):
+                rangeStart = cp
+                continue
+            first = rangeStart if fields[1].endswith(", Last>") else cp
+            rangeStart = None
+            for c in range(first, cp + 1):
+                category[c] = fields[2]
+    return version, lambda cp: eaw[cp], lambda cp: category[cp]
+
+def width(cp, eaw, category):
+    cat = category(cp)
+    if cp == 0xad:
+        return 1
+    if cat in ("Mn", "Me", "Cf") or 0x1160 <= cp <= 0x11ff or cp == 0x200b:
+        return 0
+    # the east asian width of unassigned codepoints is not reliable in the python's unicodedata, use the defaults instead
+    if cat == "Cn":
+        return 2 if any(first <= cp <= last for first, last in DEFAULT_WIDE) else 1
+    if eaw(cp) in ("W", "F"):
+        return 2
+    return 1
+
+def main():
+    if len(sys.argv) == 3:
+        version, eaw, category = loadUCD(sys.argv[1], sys.argv[2])
+    else:
+        version = unicodedata.unidata_version
+        eaw = lambda cp: unicodedata.east_asian_width(chr(cp))
+        category = lambda cp: unicodedata.category(chr(cp))
+    ranges = []
+    start = 0
+    startWidth = width(0, eaw, category)
+    for cp in range(1, MAX_CODEPOINT + 1):
+        w = width(cp, eaw, category) if cp < MAX_CODEPOINT else None
+        if w != startWidth:
+            if startWidth != 1:
+                ranges.append((start, cp - 1, startWidth))
+            start = cp
+            startWidth = w
+    print("#pragma once")
+    print("")
+    print("// Generated by tools/unicode_width.py from Unicode {}, do not edit.".format(version))
+    print("")
+    print("#include \"helpers.h\"")
+    print("")
+    print("HELPERS_NAMESPACE_BEGIN")
+    print("")
+    print("    /** Sorted, non-overlapping ranges of codepoints whose column width is not 1.")
+    print("     */")
+    print("    struct ColumnWidthRange {")
+    print("        char32_t first;")
+    print("        char32_t last;")
+    print("        unsigned char width;")
+    print("    };")
+    print("")
+    print("    constexpr ColumnWidthRange COLUMN_WIDTH_RANGES[] = {")
+    for first, last, w in ranges:
+        print("        {{0x{:x}, 0x{:x}, {}}},".format(first, last, w))
+    print("    };")
+    print("")
+    print("HELPERS_NAMESPACE_END")
+
+if __name__ == "__main__":
+    main()
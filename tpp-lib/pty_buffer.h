@@ -1,13 +1,26 @@
 #pragma once
 
+#include <algorithm>
+#include <memory>
 #include <thread>
 
+#include "helpers/ring_buffer.h"
+
 #include "pty.h"
+#include "pty_recording.h"
 
 namespace tpp {
 
     /** Wraps around given PTY and provides a buffered input. 
 
+        The input is processed by two threads. The reader thread only drains the PTY into the free space of a single producer, single consumer ring buffer and the parser thread passes the data from there to the received() method. The receiver must process all the data it is given, keeping the state of any incomplete sequences itself, so that bytes never have to be moved within the buffer. 
+
+        The reader keeps the kernel's PTY buffer empty while the data are being processed, so that programs writing in bursts are not stalled. When the processing falls behind and the ring buffer fills up, the reader stops reading from the PTY and the process writing to the terminal is throttled by the kernel, no input is ever discarded. The number of bytes waiting in the ring buffer measures how far the processing is behind. 
+
+        The size of the reads adapts to the observed throughput. Reads that fill the requested size double the size of the next read, so that floods of output are processed in large batches, while reads returning only few bytes, such as the output of interactive applications, shrink it back. 
+
+        If a recorder is provided, the reader thread tees everything read from the PTY and all resizes done via resizePty() to it, so that the session can be replayed later by the ReplayPTYMaster. 
+
         Determine what destructor does. And so on, move the buffer from terminal here. Then revisit the other classes if the PTY buffer can be reused (such as terminal client, etc)
 
      */
@@ -15,8 +28,9 @@ namespace tpp {
     class PTYBuffer {
     public:
 
-        static constexpr size_t DEFAULT_BUFFER_SIZE = 1024;
-        static constexpr size_t MAX_BUFFER_SIZE = 1024 * 1024;
+        static constexpr size_t BUFFER_SIZE = 1024 * 1024;
+        static constexpr size_t MIN_READ_SIZE = 1024;
+        static constexpr size_t MAX_READ_SIZE = 64 * 1024;
 
         virtual ~PTYBuffer() {
             if (pty_ != nullptr)
@@ -27,14 +41,33 @@ namespace tpp {
             return pty_;
         }
 
-    protected:
+        /** Returns the number of bytes read from the PTY, but not yet processed. 
+         */
+        size_t inputQueueDepth() const {
+            return queue_.size();
+        }
 
-        explicit PTYBuffer(T * pty):
-            pty_{pty} {
+        /** Returns the largest number of bytes that were waiting to be processed. 
+         */
+        size_t maxInputQueueDepth() const {
+            return queue_.maxSize();
         }
 
+    protected:
 
-        virtual size_t received(char * buffer, char const * end) = 0;
+        /** Creates the buffer for given PTY and optional recorder, taking ownership of both. 
+         */
+        explicit PTYBuffer(T * pty, PTYRecorder * recorder = nullptr):
+            pty_{pty},
+            recorder_{recorder},
+            queue_{BUFFER_SIZE} {
+        }
+
+        /** Processes the received data. 
+         
+            All of the data must be processed, as it will be overwritten by subsequent reads. 
+         */
+        virtual void received(char const * buffer, char const * bufferEnd) = 0;
 
         virtual void ptyTerminated(ExitCode exitCode) {
             MARK_AS_UNUSED(exitCode);
@@ -42,31 +75,30 @@ namespace tpp {
 
         void startPTYReader() {
             reader_ = std::thread{[this](){
-                size_t unprocessed = 0;
-                size_t bufferSize = DEFAULT_BUFFER_SIZE;
-                char * buffer = new char[DEFAULT_BUFFER_SIZE];
+                size_t readSize = MIN_READ_SIZE;
                 while (true) {
-                    size_t available = pty_->receive(buffer + unprocessed, bufferSize - unprocessed);
+                    // read straight into the free space, which may be smaller than the read size at the end of the ring, blocks while the ring is full
+                    char * buffer;
+                    size_t requested = queue_.reserve(buffer, readSize);
+                    size_t available = pty_->receive(buffer, requested);
                     // if no more bytes were read, then the PTY has been terminated, exit the loop
                     if (available == 0 && pty_->terminated())
                         break;
-                    available += unprocessed;
-                    unprocessed = available - received(buffer, buffer + available);
-                    // copy the unprocessed bytes at the beginning of the buffer
-                    memcpy(buffer, buffer + available - unprocessed, unprocessed);
-                    // grow the buffer if unprocessed == bufferSize
-                    if (unprocessed == bufferSize) {
-                        if (bufferSize < MAX_BUFFER_SIZE) {
-                            bufferSize *= 2;
-                            char * b = new char[bufferSize];
-                            memcpy(b, buffer, unprocessed);
-                            delete [] buffer;
-                            buffer = b;
-                        } else {
-                            unprocessed = 0;
-                            LOG() << "Buffer overflow, discarding " << bufferSize << " bytes";
-                        }
-                    }
+                    if (recorder_ != nullptr)
+                        recorder_->output(buffer, available);
+                    queue_.commit(available);
+                    readSize = AdjustReadSize(readSize, requested, available);
+                }
+                queue_.close();
+            }};
+            parser_ = std::thread{[this](){
+                while (true) {
+                    char const * buffer;
+                    size_t available = queue_.peek(buffer);
+                    if (available == 0)
+                        break;
+                    received(buffer, buffer + available);
+                    queue_.consume(available);
                 }
                 ptyTerminated(pty_->exitCode());
             }};
@@ -76,6 +108,7 @@ namespace tpp {
             ASSERT(pty_ != nullptr);
             pty_->terminate();
             reader_.join();
+            parser_.join();
             delete pty_;
             pty_ = nullptr;
         }
@@ -84,13 +117,33 @@ namespace tpp {
             pty_->send(what, size);
         }
 
+        void resizePty(int cols, int rows) {
+            if (recorder_ != nullptr)
+                recorder_->resize(cols, rows);
+            pty_->resize(cols, rows);
+        }
+
         T * pty_;
 
 
     private:
 
+        /** Determines the size of the next read from the size and result of the last one. 
+         
+            A read that got all it asked for only grows the read size if it was not limited by the contiguous free space at the end of the ring, and does not shrink it either way. 
+         */
+        static size_t AdjustReadSize(size_t readSize, size_t requested, size_t available) {
+            if (available == requested)
+                return (requested == readSize) ? std::min(readSize * 2, MAX_READ_SIZE) : readSize;
+            if (available < readSize / 4)
+                return std::max(readSize / 2, MIN_READ_SIZE);
+            return readSize;
+        }
 
+        std::unique_ptr<PTYRecorder> recorder_;
         std::thread reader_;
+        std::thread parser_;
+        RingBuffer queue_;
 
     }; // tpp::PTYBuffer
 
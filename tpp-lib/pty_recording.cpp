@@ -0,0 +1,188 @@
+#include <cstring>
+
+#include "pty_recording.h"
+
+namespace tpp {
+
+    namespace {
+
+        constexpr char MAGIC[] = "tpprec";
+        constexpr char VERSION = 1;
+
+    }
+
+    // PTYRecorder
+
+    PTYRecorder::PTYRecorder(std::string const & filename):
+        f_{filename, std::ios::binary},
+        last_{std::chrono::steady_clock::now()},
+        lastFlush_{last_} {
+        if (! f_.good())
+            THROW(IOError()) << "Unable to create PTY recording " << filename;
+        f_.write(MAGIC, sizeof(MAGIC) - 1);
+        f_.put(VERSION);
+    }
+
+    void PTYRecorder::output(char const * buffer, size_t numBytes) {
+        std::lock_guard<std::mutex> g{m_};
+        writeRecordHeader('o');
+        writeNumber(numBytes);
+        f_.write(buffer, numBytes);
+        if (last_ - lastFlush_ >= std::chrono::seconds{1}) {
+            f_.flush();
+            lastFlush_ = last_;
+        }
+    }
+
+    void PTYRecorder::resize(int cols, int rows) {
+        std::lock_guard<std::mutex> g{m_};
+        writeRecordHeader('r');
+        writeNumber(static_cast<uint64_t>(cols));
+        writeNumber(static_cast<uint64_t>(rows));
+        f_.flush();
+    }
+
+    void PTYRecorder::writeRecordHeader(char kind) {
+        auto now = std::chrono::steady_clock::now();
+        f_.put(kind);
+        writeNumber(std::chrono::duration_cast<std::chrono::microseconds>(now - last_).count());
+        last_ = now;
+    }
+
+    void PTYRecorder::writeNumber(uint64_t value) {
+        while (value >= 0x80) {
+            f_.put(static_cast<char>((value & 0x7f) | 0x80));
+            value >>= 7;
+        }
+        f_.put(static_cast<char>(value));
+    }
+
+    // PTYRecording
+
+    PTYRecording PTYRecording::Load(std::string const & filename) {
+        std::ifstream f{filename, std::ios::binary};
+        if (! f.good())
+            THROW(IOError()) << "Unable to open PTY recording " << filename;
+        std::string contents{std::istreambuf_iterator<char>{f}, std::istreambuf_iterator<char>{}};
+        char const * i = contents.c_str();
+        char const * end = i + contents.size();
+        if (contents.size() < sizeof(MAGIC) || strncmp(i, MAGIC, sizeof(MAGIC) - 1) != 0 || i[sizeof(MAGIC) - 1] != VERSION)
+            THROW(IOError()) << "Not a PTY recording: " << filename;
+        i += sizeof(MAGIC);
+        auto readNumber = [&]() {
+            uint64_t result = 0;
+            for (unsigned shift = 0; shift < 64; shift += 7) {
+                if (i == end)
+                    THROW(IOError()) << "Truncated PTY recording " << filename;
+                unsigned char x = static_cast<unsigned char>(*i++);
+                result |= static_cast<uint64_t>(x & 0x7f) << shift;
+                if ((x & 0x80) == 0)
+                    return result;
+            }
+            THROW(IOError()) << "Invalid number in PTY recording " << filename;
+        };
+        PTYRecording result;
+        std::chrono::microseconds time{0};
+        while (i != end) {
+            char kind = *i++;
+            time += std::chrono::microseconds{readNumber()};
+            if (kind == 'o') {
+                size_t size = readNumber();
+                if (static_cast<size_t>(end - i) < size)
+                    THROW(IOError()) << "Truncated PTY recording " << filename;
+                result.records_.push_back(Record{Record::Kind::Output, time, result.data_.size(), size});
+                result.data_.append(i, size);
+                i += size;
+            } else if (kind == 'r') {
+                size_t cols = readNumber();
+                size_t rows = readNumber();
+                result.records_.push_back(Record{Record::Kind::Resize, time, cols, rows});
+            } else {
+                THROW(IOError()) << "Invalid record kind " << kind << " in PTY recording " << filename;
+            }
+        }
+        return result;
+    }
+
+    PTYRecording PTYRecording::FromOutput(std::string const & data) {
+        PTYRecording result;
+        result.data_ = data;
+        result.records_.push_back(Record{Record::Kind::Output, std::chrono::microseconds{0}, 0, data.size()});
+        return result;
+    }
+
+    std::pair<int, int> PTYRecording::size() const {
+        for (auto const & record : records_)
+            if (record.kind == Record::Kind::Resize)
+                return std::make_pair(static_cast<int>(record.offset), static_cast<int>(record.size));
+        return std::make_pair(0, 0);
+    }
+
+    // ReplayPTYMaster
+
+    ReplayPTYMaster::ReplayPTYMaster(PTYRecording const & recording, bool realTime):
+        recording_{recording},
+        realTime_{realTime},
+        record_{0},
+        offset_{0},
+        started_{false} {
+    }
+
+    void ReplayPTYMaster::start() {
+        {
+            std::lock_guard<std::mutex> g{m_};
+            started_ = true;
+            start_ = std::chrono::steady_clock::now();
+        }
+        cv_.notify_all();
+    }
+
+    void ReplayPTYMaster::terminate() {
+        {
+            std::lock_guard<std::mutex> g{m_};
+            terminated_ = true;
+        }
+        cv_.notify_all();
+    }
+
+    void ReplayPTYMaster::send(char const * buffer, size_t numBytes) {
+        MARK_AS_UNUSED(buffer);
+        MARK_AS_UNUSED(numBytes);
+    }
+
+    /** Only the reader thread receives, so the replay position is not protected by the mutex, which only guards the waiting for the start and for the time of the next record in real time mode.
+     */
+    size_t ReplayPTYMaster::receive(char * buffer, size_t bufferSize) {
+        auto const & records = recording_.records();
+        while (record_ < records.size() && records[record_].kind != PTYRecording::Record::Kind::Output)
+            ++record_;
+        {
+            std::unique_lock<std::mutex> g{m_};
+            cv_.wait(g, [this](){ return started_ || terminated_; });
+            if (realTime_ && record_ < records.size())
+                cv_.wait_until(g, start_ + records[record_].time, [this](){ return terminated_.load(); });
+            if (terminated_)
+                return 0;
+        }
+        if (record_ == records.size()) {
+            exitCode_ = 0;
+            terminated_ = true;
+            return 0;
+        }
+        auto const & record = records[record_];
+        size_t size = std::min(bufferSize, record.size - offset_);
+        memcpy(buffer, recording_.data(record) + offset_, size);
+        offset_ += size;
+        if (offset_ == record.size) {
+            ++record_;
+            offset_ = 0;
+        }
+        return size;
+    }
+
+    void ReplayPTYMaster::resize(int cols, int rows) {
+        MARK_AS_UNUSED(cols);
+        MARK_AS_UNUSED(rows);
+    }
+
+} // namespace tpp
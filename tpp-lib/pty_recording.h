@@ -0,0 +1,130 @@
+#pragma once
+
+#include <chrono>
+#include <fstream>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+
+#include "pty.h"
+
+namespace tpp {
+
+    /** Records the data received from a PTY together with their arrival times.
+
+        The recording is a compact binary file starting with the `tpprec` magic and a version byte, followed by records. Each record starts with its kind and the time elapsed since the previous record in microseconds, encoded as unsigned LEB128 number:
+
+        - `o` is output, followed by the number of bytes and the bytes themselves as received from the PTY
+        - `r` is terminal resize, followed by the columns and rows
+
+        The recorder is thread safe as output is recorded by the PTY reader thread while resizes come from the UI thread. The file is flushed every second so that the recording is usable even if the session never terminates properly.
+     */
+    class PTYRecorder {
+    public:
+
+        /** Creates the recording file, throws IOError on failure.
+         */
+        explicit PTYRecorder(std::string const & filename);
+
+        void output(char const * buffer, size_t numBytes);
+
+        void resize(int cols, int rows);
+
+    private:
+
+        void writeRecordHeader(char kind);
+
+        void writeNumber(uint64_t value);
+
+        std::mutex m_;
+        std::ofstream f_;
+        std::chrono::steady_clock::time_point last_;
+        std::chrono::steady_clock::time_point lastFlush_;
+
+    }; // tpp::PTYRecorder
+
+    /** A recording of PTY output loaded in memory.
+     */
+    class PTYRecording {
+    public:
+
+        struct Record {
+            enum class Kind {
+                Output,
+                Resize,
+            };
+            Kind kind;
+            /** Time of the record since the beginning of the recording. */
+            std::chrono::microseconds time;
+            /** Offset and size of the output data, or columns and rows of the resize. */
+            size_t offset;
+            size_t size;
+        };
+
+        /** Loads the recording from given file, throws IOError if the file can't be read and is not a valid recording.
+         */
+        static PTYRecording Load(std::string const & filename);
+
+        /** Creates a recording of given data received all at once.
+         */
+        static PTYRecording FromOutput(std::string const & data);
+
+        std::vector<Record> const & records() const {
+            return records_;
+        }
+
+        char const * data(Record const & record) const {
+            ASSERT(record.kind == Record::Kind::Output);
+            return data_.c_str() + record.offset;
+        }
+
+        /** Returns the total number of output bytes.
+         */
+        size_t outputSize() const {
+            return data_.size();
+        }
+
+        /** Returns the columns and rows of the first resize record, or 0 if there is none.
+         */
+        std::pair<int, int> size() const;
+
+    private:
+
+        std::string data_;
+        std::vector<Record> records_;
+
+    }; // tpp::PTYRecording
+
+    /** Pseudoterminal master which replays a recording.
+
+        The output is replayed either at the original speed, or as fast as it can be received. The replay does not start until start() is called, so that the terminal can be fully set up first. When the whole recording has been received the PTY terminates with exit code 0. Input sent to the PTY and resizes are ignored, resize records of the recording are not replayed.
+     */
+    class ReplayPTYMaster : public PTYMaster {
+    public:
+
+        /** Creates the replay of given recording, which must outlive the PTY.
+         */
+        ReplayPTYMaster(PTYRecording const & recording, bool realTime);
+
+        void start();
+
+        void terminate() override;
+        void send(char const * buffer, size_t numBytes) override;
+        size_t receive(char * buffer, size_t bufferSize) override;
+        void resize(int cols, int rows) override;
+
+    private:
+
+        PTYRecording const & recording_;
+        bool realTime_;
+        /** Index of the next record to replay and the offset within its output. */
+        size_t record_;
+        size_t offset_;
+        bool started_;
+        std::chrono::steady_clock::time_point start_;
+        std::mutex m_;
+        std::condition_variable cv_;
+
+    }; // tpp::ReplayPTYMaster
+
+} // namespace tpp
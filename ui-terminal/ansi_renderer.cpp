@@ -88,8 +88,13 @@ namespace ui {
                     state.font().setBlink(c.font().blink());
                     s << ansi::Blink(state.font().blink());
                 }
-                // finally output the codepoint
-                s << Char{c.codepoint()};
+                // finally output the codepoint, or all codepoints of a grapheme cluster
+                if (c.isGrapheme()) {
+                    for (char32_t cp : buffer.graphemes()[c.graphemeId()])
+                        s << Char{cp};
+                } else {
+                    s << Char{c.codepoint()};
+                }
             }
         }
         // TODO this is a very unnecessary copy, should be fixed
@@ -1,4 +1,5 @@
 #include <functional>
+#include <iomanip>
 
 #include "helpers/memory.h"
 
@@ -34,7 +35,7 @@ namespace ui {
     std::unordered_set<Key> AnsiTerminal::PrintableKeys_;
 
 
-    Log AnsiTerminal::SEQ("VT100");
+    decltype(AnsiTerminal::SEQ) AnsiTerminal::SEQ("VT100");
     Log AnsiTerminal::SEQ_UNKNOWN("VT100_UNKNOWN");
     Log AnsiTerminal::SEQ_ERROR("VT100_ERROR");
     Log AnsiTerminal::SEQ_WONT_SUPPORT("VT100_WONT_SUPPORT");
@@ -42,25 +43,39 @@ namespace ui {
 
     char32_t AnsiTerminal::LineDrawingChars_[15] = {0x2518, 0x2510, 0x250c, 0x2514, 0x253c, 0, 0, 0x2500, 0, 0, 0x251c, 0x2524, 0x2534, 0x252c, 0x2502};
 
-    AnsiTerminal::AnsiTerminal(tpp::PTYMaster * pty, Palette && palette):
-        PTYBuffer{pty},
+    AnsiTerminal::AnsiTerminal(tpp::PTYMaster * pty, Palette && palette, tpp::PTYRecorder * recorder):
+        PTYBuffer{pty, recorder},
         palette_{palette},
-        state_{new State{palette.defaultBackground()}},
-        stateBackup_{new State{palette.defaultBackground()}} {
+        initialPalette_{palette},
+        state_{new State{Palette::Indexed(Palette::DEFAULT_BG)}},
+        stateBackup_{new State{Palette::Indexed(Palette::DEFAULT_BG)}} {
         if (KeyMap_.empty()) {
             InitializeKeyMap(KeyMap_);
             InitializePrintableKeys(PrintableKeys_);
         }
-        state_->reset(palette_.defaultForeground(), palette_.defaultBackground());
-        stateBackup_->reset(palette_.defaultForeground(), palette_.defaultBackground());
+        state_->reset(Palette::Indexed(Palette::DEFAULT_FG), Palette::Indexed(Palette::DEFAULT_BG));
+        stateBackup_->reset(Palette::Indexed(Palette::DEFAULT_FG), Palette::Indexed(Palette::DEFAULT_BG));
+        // history rows and both buffers share the same grapheme clusters
+        stateBackup_->buffer.shareGraphemes(state_->buffer);
         setFocusable(true);
 
         startPTYReader();
 
     }
 
+    void AnsiTerminal::setPalette(Palette const & palette) {
+        {
+            std::lock_guard<PriorityLock> g{bufferLock_.priorityLock(), std::adopt_lock};
+            palette_ = palette;
+            initialPalette_ = palette;
+        }
+        repaint();
+    }
+
     AnsiTerminal::~AnsiTerminal() {
         terminatePty();
+        if (memoryBudget_ != nullptr)
+            memoryBudget_->update(budgetedBytes_, 0);
         delete state_;
         delete stateBackup_;
     }
@@ -74,22 +89,38 @@ namespace ui {
 #endif
         Rect visibleRect{ccanvas.visibleRect()};
         std::lock_guard<PriorityLock> g(bufferLock_.priorityLock(), std::adopt_lock);
+        bytesSinceFrame_ = 0;
+        lastFrame_ = std::chrono::steady_clock::now();
         int top = terminalBufferTop();
+        if (detectHyperlinks_)
+            detectHyperlinks(visibleRect.top(), visibleRect.bottom());
         ccanvas.setBg(palette_.defaultBackground());
-        // see if there are any history lines that need to be drawn
+        // see if there are any history lines that need to be drawn, the styles of the whole row are resolved at once
+        std::vector<Cell> historyCells;
         for (int row = std::max(0, visibleRect.top()), re = std::min(top, visibleRect.bottom()); row < re ; ++row) {
-            for (int col = 0, ce = historyRows_[row].first; col < ce; ++col) {
-                ccanvas.at(Point{col, row}).stripSpecialObjectAndAssign(historyRows_[row].second[col]);
+            history_.unpack(row, historyCells);
+            int cols = static_cast<int>(historyCells.size());
+            ccanvas.drawFallbackCells(historyCells.data(), cols, Point{0, row}, state_->buffer.graphemes());
 #ifdef SHOW_LINE_ENDINGS
-                if (Buffer::IsLineEnd(historyRows_[row].second[col]))
+            for (int col = 0; col < cols; ++col) {
+                if (Buffer::IsLineEnd(historyCells[col]))
                     ccanvas.setBorder(Point{col, row}, endOfLine);
-#endif
             }
-            ccanvas.fill(Rect{Point{historyRows_[row].first, row}, Point{width(), row + 1}},
+#endif
+            ccanvas.fill(Rect{Point{cols, row}, Point{width(), row + 1}},
             Cell{}.setBg(ccanvas.bg()));
         }
         // TODO once we support sixels or other shared objects that might survive to the drawing stage, this function will likely change.
         ccanvas.drawFallbackBuffer(state_->buffer, Point{0, top});
+        // the cells refer to the palette, resolve the colors of the visible ones before anything is blended over them
+        for (int row = std::max(0, visibleRect.top()), re = std::min(top + state_->buffer.height(), visibleRect.bottom()); row < re; ++row) {
+            for (int col = std::max(0, visibleRect.left()), ce = std::min(width(), visibleRect.right()); col < ce; ++col) {
+                Cell & c = ccanvas.at(Point{col, row});
+                c.setFg(palette_.resolve(c.fg()))
+                 .setBg(palette_.resolve(c.bg()))
+                 .setDecor(palette_.resolve(c.decor()));
+            }
+        }
 #ifdef  SHOW_LINE_ENDINGS
         // now add borders to the cells that are marked as end of line
         for (int row = std::max(top, visibleRect.top()), rs = row, re = visibleRect.bottom(); ; ++row) {
@@ -182,6 +213,10 @@ namespace ui {
             {
                 std::lock_guard<PriorityLock> g(bufferLock_.priorityLock(), std::adopt_lock);
                 bufferCoords = toBufferCoords(e->coords);
+                if (detectHyperlinks_) {
+                    int row = toContentsCoords(e->coords).y();
+                    detectHyperlinks(row, row + 1);
+                }
                 Hyperlink * a = hyperlinkAt(e->coords);
                 // if there is active hyperlink that is different from current special object, deactive it
                 if (activeHyperlink_ != nullptr && activeHyperlink_ != a) {
@@ -259,7 +294,7 @@ namespace ui {
     void AnsiTerminal::mouseWheel(MouseWheelEvent::Payload & e) {
         onMouseWheel(e, this);
         if (e.active()) {
-            if (! alternateMode_ && historyRows_.size() > 0) {
+            if (! alternateMode_ && history_.size() > 0) {
                 if (e->by > 0)
                     scrollBy(Point{0, -3});
                 else
@@ -343,23 +378,30 @@ namespace ui {
         int endRow = sel.end().y();
         int col = sel.start().x();
         std::lock_guard<PriorityLock> g(bufferLock_);
-        int terminalTop =  alternateMode_ ? 0 : static_cast<int>(historyRows_.size());
+        int terminalTop =  alternateMode_ ? 0 : history_.size();
+        std::vector<Cell> historyCells;
         while (row < endRow) {
             int endCol = (row < endRow - 1) ? width() : sel.end().x();
             Cell * rowCells;
             // if the current row comes from the history, get the appropriate cells
             if (row < terminalTop) {
-                rowCells = historyRows_[row].second;
+                history_.unpack(row, historyCells);
+                rowCells = historyCells.data();
                 // if the stored row is shorter than the start of the selection, adjust the endCol so that no processing will be involved
-                if (endCol > historyRows_[row].first)
-                    endCol = historyRows_[row].first;
+                if (endCol > static_cast<int>(historyCells.size()))
+                    endCol = static_cast<int>(historyCells.size());
             } else {
                 rowCells = state_->buffer.row(row - terminalTop);
             }
             // analyze the line and add it to the selection now
             std::stringstream line;
             for (; col < endCol; ) {
-                line << Char{rowCells[col].codepoint()};
+                if (rowCells[col].isGrapheme()) {
+                    for (char32_t cp : state_->buffer.graphemes()[rowCells[col].graphemeId()])
+                        line << Char{cp};
+                } else {
+                    line << Char{rowCells[col].codepoint()};
+                }
                 if (Buffer::IsLineEnd(rowCells[col]))
                     line << std::endl;
                 col += rowCells[col].font().width();
@@ -392,22 +434,20 @@ namespace ui {
         Point end = pos;
         {
             std::lock_guard<PriorityLock> g(bufferLock_);
-            Cell const * c = cellAt(pos);
+            Cell c;
             // if there is nothing at the coordinates, or we are not inside a word, do nothing
-            if (c == nullptr || IsWordSeparator(c->codepoint()))
+            if (! cellAt(pos, c) || IsWordSeparator(c))
                 return;
             // find beginning and end of the word
             while (true) {
                 Point prev = prevCell(start);
-                c = cellAt(prev);
-                if (c == nullptr || IsWordSeparator(c->codepoint()))
+                if (! cellAt(prev, c) || IsWordSeparator(c))
                     break;
                 start = prev;
             }
             while(true) {
                 Point next = nextCell(end);
-                c = cellAt(next);
-                if (c == nullptr || IsWordSeparator(c->codepoint()))
+                if (! cellAt(next, c) || IsWordSeparator(c))
                     break;
                 end = next;
             }
@@ -421,11 +461,11 @@ namespace ui {
         Point end = start;
         {
             std::lock_guard<PriorityLock> g(bufferLock_);
+            Cell c;
             // see if the above line ends with a line end character
             while (start != Point{0,0}) {
                 start = prevCell(start);
-                Cell const * c = cellAt(start);
-                if (c != nullptr && Buffer::IsLineEnd(*c)) {
+                if (cellAt(start, c) && Buffer::IsLineEnd(c)) {
                     start = Point{0, start.y() + 1};
                     break;
                 }
@@ -433,8 +473,7 @@ namespace ui {
             // now find end of the line at cursor
             Point bottomRight = Point{state_->buffer.width() - 1, state_->buffer.height() - 1 + terminalBufferTop()};
             while (end != bottomRight) {
-                Cell const * c = cellAt(end);
-                if (c != nullptr && Buffer::IsLineEnd(*c))
+                if (cellAt(end, c) && Buffer::IsLineEnd(c))
                     break;
                 end = nextCell(end);
             }
@@ -444,34 +483,124 @@ namespace ui {
     }
 
 
-    void AnsiTerminal::detectHyperlink(char32_t next) {
+    void AnsiTerminal::detectHyperlinks(int top, int bottom) {
         ASSERT(bufferLock_.locked());
-        // don't do any mathing if we are inside hyperlink command
-        if (inProgressHyperlink_ != nullptr)
+        int rows = terminalBufferTop() + state_->buffer.height();
+        top = std::max(top, 0);
+        bottom = std::min(bottom, rows);
+        // forget the lines that are no longer visible when there are too many
+        if (hyperlinkLines_.size() > static_cast<size_t>(state_->buffer.height()) * 4)
+            hyperlinkLines_.clear();
+        // start at the beginning of the line wrapped into the first row
+        int start = top;
+        while (start > 0 && top - start < MAX_URL_ROWS && ! isLineEnd(start - 1))
+            --start;
+        while (start < bottom) {
+            int end = start;
+            while (end + 1 < rows && end + 1 - bottom < MAX_URL_ROWS && ! isLineEnd(end))
+                ++end;
+            detectLineHyperlinks(start, end + 1);
+            start = end + 1;
+        }
+    }
+
+    /** The line is identified by the absolute number of its first row and its hash is checked before any of its cells are unpacked. 
+     */
+    void AnsiTerminal::detectLineHyperlinks(int top, int bottom) {
+        size_t & hash = hyperlinkLines_[history_.firstRow() + static_cast<size_t>(top)];
+        size_t newHash = hyperlinkLineHash(top, bottom);
+        if (hash == newHash)
             return;
-        size_t matchSize = urlMatcher_.next(next);
-        if (matchSize == 0)
+        hash = newHash;
+        int bufferTop = terminalBufferTop();
+        // history rows of the line are unpacked and packed back only if their hyperlinks change
+        std::vector<std::vector<Cell>> historyCells(std::max(0, std::min(bottom, bufferTop) - top));
+        // the line's cells, without the columns covered by double width characters
+        std::vector<Cell *> cells;
+        for (int row = top; row < bottom; ++row) {
+            int cols = state_->buffer.width();
+            Cell * rowCells;
+            if (row < bufferTop) {
+                history_.unpack(row, historyCells[row - top]);
+                cols = static_cast<int>(historyCells[row - top].size());
+                rowCells = historyCells[row - top].data();
+            } else {
+                rowCells = state_->buffer.row(row - bufferTop);
+            }
+            for (int col = 0; col < cols; col += rowCells[col].font().width())
+                cells.push_back(rowCells + col);
+        }
+        // detach the hyperlinks detected previously, the line has changed
+        bool changed = false;
+        for (Cell * c : cells) {
+            if (c->hasSpecialObject() && dynamic_cast<DetectedHyperlink *>(c->specialObject()) != nullptr) {
+                c->detachSpecialObject();
+                changed = true;
+            }
+        }
+        // match the urls and attach the hyperlinks to their cells
+        UrlMatcher matcher;
+        for (size_t i = 0, e = cells.size(); i <= e; ++i) {
+            // cells with other special objects attached, such as OSC 8 hyperlinks, separate the urls
+            size_t size = (i == e) ? matcher.reset() : matcher.next(cells[i]->hasSpecialObject() ? ' ' : state_->buffer.baseCodepoint(*cells[i]));
+            if (size == 0)
+                continue;
+            Hyperlink::Ptr link{new DetectedHyperlink{"", normalHyperlinkStyle_, activeHyperlinkStyle_}};
+            std::stringstream url;
+            for (size_t j = i - size; j < i; ++j) {
+                url << Char{state_->buffer.baseCodepoint(*cells[j])};
+                cells[j]->attachSpecialObject(link);
+            }
+            link->setUrl(url.str());
+            changed = true;
+        }
+        if (! changed)
             return;
-        // we have found a hyperlink, construct its address and determine which cells to use, which we do by retracting
-        Hyperlink::Ptr link{new Hyperlink{"", normalHyperlinkStyle_, activeHyperlinkStyle_}};
-        std::string url{};
-        Point pos = cursorPosition();
-        do {
-            // the url is too long and disappeared, do not match
-            if (pos == Point{0,0}) {
-                link->detachFromAllCells();
-                return;
+        // pack the history rows back in place, which changes their styles and so the hash
+        for (size_t i = 0; i < historyCells.size(); ++i) {
+            auto r = history_.mutableRow(top + static_cast<int>(i));
+            for (int col = 0; col < r.first; ++col) {
+                PackedCell old = r.second[col];
+                r.second[col] = history_.styles().pack(historyCells[i][col]);
+                history_.styles().release(old);
             }
-            if (pos.x() == 0)
-                pos = Point{state_->buffer.width() - 1, pos.y() - 1};
-            else
-                pos -= Point{1, 0};
-            Cell & cell = state_->buffer.at(pos);
-            url = Char{cell.codepoint()} + url;
-            cell.attachSpecialObject(link);
-        } while (--matchSize != 0);
-        // set the url we calculated
-        link->setUrl(url);
+        }
+        hash = hyperlinkLineHash(top, bottom);
+    }
+
+    /** Packed cells are hashed by their style, which includes the attached special object, while the cells of the buffer only by whether they have a special object attached, so that rewritten cells without the detected hyperlinks are detected again. 
+     */
+    size_t AnsiTerminal::hyperlinkLineHash(int top, int bottom) {
+        int bufferTop = terminalBufferTop();
+        size_t hash = static_cast<size_t>(bottom - top);
+        for (int row = top; row < bottom; ++row) {
+            if (row < bufferTop) {
+                auto r = history_.row(row);
+                hash = hash * 31 + static_cast<size_t>(r.first);
+                for (PackedCell const * c = r.second, * e = r.second + r.first; c != e; ++c)
+                    hash = (hash * 31 + c->rawCodepoint()) * 31 + c->style();
+            } else {
+                for (Cell const * c = state_->buffer.row(row - bufferTop), * e = c + state_->buffer.width(); c != e; ++c)
+                    hash = hash * 31 + (c->codepoint() | (c->isGrapheme() ? 0x200000 : 0) | (c->hasSpecialObject() ? 0x400000 : 0));
+            }
+        }
+        return hash;
+    }
+
+    bool AnsiTerminal::isLineEnd(int row) {
+        int bufferTop = terminalBufferTop();
+        if (row < bufferTop) {
+            auto r = history_.row(row);
+            for (int col = r.first - 1; col >= 0; --col)
+                if (Buffer::IsLineEnd(r.second[col]))
+                    return true;
+            return r.first == 0;
+        }
+        Cell const * cells = state_->buffer.row(row - bufferTop);
+        for (int col = state_->buffer.width() - 1; col >= 0; --col)
+            if (Buffer::IsLineEnd(cells[col]))
+                return true;
+        return false;
     }
 
     // Terminal State
@@ -518,106 +647,114 @@ namespace ui {
     // Scrollback buffer
 
     void AnsiTerminal::insertLines(int lines, int top, int bottom, Cell const & fill) {
-        while (lines-- > 0)
-            state_->buffer.insertLine(top, bottom, fill);
+        state_->buffer.insertLines(lines, top, bottom, fill);
     }
 
-    /** If history is enabled, i.e. when history limit is greater than 0 and the terminal is not in alternate mode, the deleted line is added to the history.
+    /** If history is enabled, i.e. when history limit is greater than 0 and the terminal is not in alternate mode, the deleted lines are added to the history.
+
+        All lines are scrolled at once. When more lines than the region's height are deleted, the excess lines scrolled out are the already cleared ones, which is what deleting the lines one by one would add to the history too, but no more than the history can hold as the rest would be trimmed anyway. The history is trimmed in bulk by the caller, only after the whole input slice has been parsed.
      */
     void AnsiTerminal::deleteLines(int lines, int top, int bottom, Cell const & fill) {
-        // scroll the lines
-        while (lines-- > 0) {
-            if (! alternateMode_ && maxHistoryRows_ != 0) {
-                auto removedRow = state_->buffer.copyRow(top, palette_.defaultBackground());
-                addHistoryRow(removedRow.first, removedRow.second);
-            }
-            state_->buffer.deleteLine(top, bottom, fill);
-        }
+        int scrolled = std::min(lines, bottom - top);
+        if (scrolled <= 0)
+            return;
+        bool history = ! alternateMode_ && maxHistoryRows_ != 0;
+        if (history)
+            for (int row = top, e = top + scrolled; row < e; ++row)
+                addHistoryRow(state_->buffer.row(row), state_->buffer.historyRowLength(row, Palette::Indexed(Palette::DEFAULT_BG)));
+        state_->buffer.deleteLines(scrolled, top, bottom, fill);
+        if (history)
+            for (int i = 0, e = std::min(lines - scrolled, maxHistoryRows_); i < e; ++i)
+                addHistoryRow(state_->buffer.row(top), state_->buffer.historyRowLength(top, Palette::Indexed(Palette::DEFAULT_BG)));
+    }
+
+    void AnsiTerminal::addHistoryRow(Cell const * row, int cols) {
+        history_.append(row, cols, cols == 0 || Buffer::IsLineEnd(row[cols - 1]));
+        ++historyRowsAdded_;
+    }
+
+    AnsiTerminal::MemoryUsage AnsiTerminal::memoryUsage() {
+        std::lock_guard<PriorityLock> g{bufferLock_};
+        MemoryUsage result;
+        result.history = history_.bytes();
+        result.historyFile = history_.fileBytes();
+        // the buffers share the grapheme table
+        result.buffers = state_->buffer.bytes() + stateBackup_->buffer.bytes() + state_->buffer.graphemes().bytes();
+        std::unordered_set<Canvas::SpecialObject *> objects;
+        state_->buffer.addSpecialObjectsTo(objects);
+        stateBackup_->buffer.addSpecialObjectsTo(objects);
+        history_.styles().addSpecialObjectsTo(objects);
+        for (Canvas::SpecialObject * so : objects)
+            result.specialObjects += so->bytes();
+        return result;
     }
 
-    /** If the terminal is scrolled into view, scrolls the terminal into view after the history line has been added as well.
+    void AnsiTerminal::setMemoryBudget(MemoryBudget * budget) {
+        std::lock_guard<PriorityLock> g{bufferLock_};
+        if (memoryBudget_ != nullptr)
+            memoryBudget_->update(budgetedBytes_, 0);
+        memoryBudget_ = budget;
+        budgetedBytes_ = 0;
+        trimHistory();
+    }
+
+    /** The buffers can't be deleted, so they only limit the memory left for the history. Special objects of the buffers are not counted as finding them is too expensive to do every time rows are added.
      */
-    void AnsiTerminal::addHistoryRow(Cell * row, int cols) {
-        if (cols <= width()) {
-            historyRows_.push_back(std::make_pair(cols, row));
-        // if the line is too long, simply chop it in pieces of maximal length
-        } else {
-            Cell * i = row;
-            while (cols != 0) {
-                int xSize = std::min(width(), cols);
-                Cell * x = new Cell[xSize];
-                // copy the cells one by one as they are PODs
-                MemCopy(x, i, xSize);
-                i += xSize;
-                cols -= xSize;
-                historyRows_.push_back(std::make_pair(xSize, x));
-            }
-            delete [] row;
+    void AnsiTerminal::trimHistory() {
+        size_t buffers = state_->buffer.bytes() + stateBackup_->buffer.bytes();
+        size_t limit = std::numeric_limits<size_t>::max();
+        if (memoryLimit_ != 0)
+            limit = memoryLimit_ > buffers ? memoryLimit_ - buffers : 0;
+        if (memoryBudget_ != nullptr && memoryBudget_->limit() != 0) {
+            size_t others = memoryBudget_->used() - budgetedBytes_ + buffers;
+            limit = std::min(limit, memoryBudget_->limit() > others ? memoryBudget_->limit() - others : 0);
         }
-        while (historyRows_.size() > static_cast<size_t>(maxHistoryRows_)) {
-            delete [] historyRows_.front().second;
-            historyRows_.pop_front();
+        history_.trim(maxHistoryRows_, limit);
+        if (memoryBudget_ != nullptr) {
+            size_t used = buffers + history_.bytes() + history_.styles().specialObjectBytes();
+            memoryBudget_->update(budgetedBytes_, used);
+            budgetedBytes_ = used;
         }
-        if (scrollToTerminal_)
-            schedule([this](){
-                setScrollOffset(Point{0, static_cast<int>(historyRows_.size())});
-            });
     }
 
+    /** The history stores whole lines, so that only the number of their rows at the new width is recounted. 
+     */
     void AnsiTerminal::resizeHistory() {
-        std::deque<std::pair<int, Cell*>> oldRows{std::move(historyRows_)};
-        Cell * row = nullptr;
-        int rowSize = 0;
-        for (auto & i : oldRows) {
-            if (row == nullptr) {
-                row = i.second;
-                rowSize = i.first;
-            } else {
-                Cell * newRow = new Cell[rowSize + i.first];
-                MemCopy(newRow, row, rowSize);
-                MemCopy(newRow + rowSize, i.second, i.first);
-                rowSize += i.first;
-                delete [] i.second;
-                delete [] row;
-                row = newRow;
-            }
-            ASSERT(row != nullptr);
-            if (Buffer::IsLineEnd(row[rowSize - 1])) {
-                addHistoryRow(row, rowSize);
-                row = nullptr;
-                rowSize = 0;
-            }
-        }
-        if (row != nullptr)
-            addHistoryRow(row, rowSize);
+        history_.setWidth(width());
+        // the rows are numbered anew
+        hyperlinkLines_.clear();
     }
 
     void AnsiTerminal::resizeBuffers(Size size) {
+        auto addToHistory = [this](Cell const * row, int cols) {
+            addHistoryRow(row, cols);
+        };
         if (alternateMode_) {
             state_->resize(size, nullptr);
-            stateBackup_->resize(size, std::bind(&AnsiTerminal::addHistoryRow, this, std::placeholders::_1, std::placeholders::_2));
+            stateBackup_->resize(size, addToHistory);
         } else {
-            state_->resize(size, std::bind(&AnsiTerminal::addHistoryRow, this, std::placeholders::_1, std::placeholders::_2));
+            state_->resize(size, addToHistory);
             stateBackup_->resize(size, nullptr);
         }
     }
 
-    AnsiTerminal::Cell const * AnsiTerminal::cellAt(Point coords) {
+    bool AnsiTerminal::cellAt(Point coords, Cell & result) {
         ASSERT(bufferLock_.locked());
         int bufferTop = terminalBufferTop();
         if (bufferTop <= coords.y()) {
             coords -= Point{0, bufferTop};
             if (! state_->buffer.contains(coords))
-                return nullptr;
-            return & const_cast<Buffer const &>(state_->buffer).at(coords);
+                return false;
+            result = const_cast<Buffer const &>(state_->buffer).at(coords);
         } else {
             if (coords.y() < 0)
-                return nullptr;
-            auto const & row = historyRows_[coords.y()];
+                return false;
+            auto row = history_.row(coords.y());
             if (coords.x() >= row.first)
-                return nullptr;
-            return row.second + coords.x();
+                return false;
+            history_.styles().unpack(row.second[coords.x()], result);
         }
+        return true;
     }
 
     Point AnsiTerminal::prevCell(Point coords) const {
@@ -638,75 +775,45 @@ namespace ui {
 
     // Input Processing
 
-    size_t AnsiTerminal::received(char * buffer, char const * bufferEnd) {
-        {
-            std::lock_guard<PriorityLock> g(bufferLock_);
-            // then process the input
-            char const * x = buffer;
-            while (x != bufferEnd) {
-                switch (*x) {
-                    /* Parse the escape sequence */
-                    case Char::ESC: {
-                        size_t processed = parseEscapeSequence(x, bufferEnd);
-                        // if no characters were processed, the sequence was incomplete and we should end processing
-                        if (processed == 0)
-                            return x - buffer;
-                        // move past the sequence
-                        x += processed;
-                        break;
-                    }
-                    /* BEL triggers the notification */
-                    case Char::BEL:
-                        parseNotification();
-                        ++x;
-                        break;
-                    case Char::TAB:
-                        parseTab();
-                        ++x;
-                        break;
-                    case Char::LF:
-                        parseLF();
-                        ++x;
-                        break;
-                    case Char::CR:
-                        parseCR();
-                        ++x;
-                        break;
-                    case Char::BACKSPACE:
-                        parseBackspace();
-                        ++x;
-                        break;
-                    default: {
-                        // while this is a code duplication from the Char class, since this code is a bottleneck for processing large ammounts of text, the code is copied for performance
-                        char32_t cp = 0;
-                        unsigned char const * ux = pointer_cast<unsigned char const *>(x);
-                        if (*ux < 0x80) {
-                            cp = *ux;
-                            ++x;
-                        } else if (*ux < 0xe0) {
-                            if (x + 2 > bufferEnd)
-                                return x - buffer;
-                            cp = ((ux[0] & 0x1f) << 6) + (ux[1] & 0x3f);
-                            x += 2;
-                        } else if (*ux < 0xf0) {
-                            if (x + 3 > bufferEnd)
-                                return x - buffer;
-                            cp = ((ux[0] & 0x0f) << 12) + ((ux[1] & 0x3f) << 6) + (ux[2] & 0x3f);
-                            x += 3;
-                        } else {
-                            if (x + 4 > bufferEnd)
-                                return x - buffer;
-                            cp = ((ux[0] & 0x07) << 18) + ((ux[1] & 0x3f) << 12) + ((ux[2] & 0x3f) << 6) + (ux[3] & 0x3f);
-                            x += 4;
-                        }
-                        parseCodepoint(cp);
-                        break;
-                    }
-                }
+    void AnsiTerminal::received(char const * buffer, char const * bufferEnd) {
+        size_t size = static_cast<size_t>(bufferEnd - buffer);
+        std::lock_guard<PriorityLock> g(bufferLock_);
+        bytesSinceFrame_ += size;
+        while (true) {
+            char const * sliceEnd = buffer + std::min(parserSliceSize_, static_cast<size_t>(bufferEnd - buffer));
+            parse(buffer, sliceEnd);
+            buffer = sliceEnd;
+            trimHistory();
+            if (buffer == bufferEnd)
+                break;
+            // if the UI thread waits for the buffer, release it between the slices, the lock can't be reacquired before the priority request is serviced
+            if (bufferLock_.priorityRequested()) {
+                scheduleViewUpdate();
+                bufferLock_.unlock();
+                bufferLock_.lock();
+            }
+        }
+        // jump scroll: if the output floods the terminal and more input is already waiting, the intermediate states are not displayed unless a frame is due, the last input of the flood always updates the view
+        if (jumpScrollThreshold_ != 0 && bytesSinceFrame_ > jumpScrollThreshold_ && inputQueueDepth() > size) {
+            if (std::chrono::steady_clock::now() - lastFrame_ < JUMP_SCROLL_FRAME)
+                return;
+        }
+        scheduleViewUpdate();
+    }
+
+    void AnsiTerminal::scheduleViewUpdate() {
+        ASSERT(bufferLock_.locked());
+        if (historyRowsAdded_ != 0) {
+            historyRowsAdded_ = 0;
+            if (scrollToTerminal_ && ! pendingScrollToTerminal_.exchange(true)) {
+                schedule([this](){
+                    pendingScrollToTerminal_ = false;
+                    if (scrollToTerminal_)
+                        setScrollOffset(Point{0, historyRows()});
+                });
             }
         }
         scheduleRepaint();
-        return bufferEnd - buffer;
     }
 
 
@@ -714,10 +821,23 @@ namespace ui {
         if (lineDrawingSet_ && codepoint >= 0x6a && codepoint < 0x79)
             codepoint = LineDrawingChars_[codepoint-0x6a];
         LOG(SEQ) << "codepoint " << Char{codepoint} << " " << static_cast<char>(codepoint & 0xff);
-        // detect the hyperlinks if enabled, before updating the cursor position
-        if (detectHyperlinks_)
-            detectHyperlink(codepoint);
+        // zero width characters, such as combining marks, and characters following a zero width joiner are appended to the grapheme cluster of the previous character and do not move the cursor
+        int columnWidth = Char::ColumnWidth(codepoint);
+        if (columnWidth == 0 || followsJoiner()) {
+            appendToGrapheme(codepoint);
+            return;
+        }
+        // a double width character never fits a single column terminal, it is displayed as single width instead
+        if (columnWidth == 2 && state_->buffer.width() < 2)
+            columnWidth = 1;
         updateCursorPosition();
+        // if a double width character does not fit on the line, the last column is left blank and the character is wrapped
+        if (columnWidth == 2 && cursorPosition().x() == state_->buffer.width() - 1) {
+            state_->buffer.at(cursorPosition()) = state_->cell;
+            state_->buffer.at(cursorPosition()).setCodepoint(' ');
+            setCursorPosition(cursorPosition() + Point{1, 0});
+            updateCursorPosition();
+        }
         // set the cell according to the codepoint and current settings. If there is an active hyperlink, the hyperlink is first attached to the cell and then new cell is added to the hyperlink fallback
         Cell & cell = state_->buffer.at(cursorPosition());
         cell = state_->cell;
@@ -725,12 +845,13 @@ namespace ui {
         if (inProgressHyperlink_ != nullptr)
             cell.attachSpecialObject(inProgressHyperlink_);
         cell.setCodepoint(codepoint);
-        // what's left is to deal with corner cases, such as larger fonts & double width characters
-        int columnWidth = Char::ColumnWidth(codepoint);
-        // if the character's column width is 2 and current font is not double width, update to double width font
-        if (columnWidth == 2 && ! cell.font().doubleWidth()) {
-            //columnWidth = 1;
+        // if the character's column width is 2, update to double width font and blank the column covered by the character, which is not drawn
+        if (columnWidth == 2) {
             cell.font().setDoubleWidth(true);
+            setCursorPosition(cursorPosition() + Point{1, 0});
+            Cell & covered = state_->buffer.at(cursorPosition());
+            covered = state_->cell;
+            covered.setCodepoint(' ');
         }
 
         // advance cursor's column
@@ -764,6 +885,97 @@ namespace ui {
         */
     }
 
+    AnsiTerminal::Cell * AnsiTerminal::previousCharacter() {
+        Point pos = cursorPosition();
+        // nothing to append to at the beginning of a line
+        if (pos.x() == 0 || pos.y() >= state_->buffer.height())
+            return nullptr;
+        Cell * row = state_->buffer.row(pos.y());
+        int col = std::min(pos.x(), state_->buffer.width()) - 1;
+        // skip the column covered by a double width character
+        if (col > 0 && row[col - 1].font().doubleWidth())
+            --col;
+        return row + col;
+    }
+
+    bool AnsiTerminal::followsJoiner() {
+        Cell * cell = previousCharacter();
+        return cell != nullptr && cell->isGrapheme() && state_->buffer.graphemes()[cell->graphemeId()].back() == Char::ZWJ;
+    }
+
+    /** The cell is accessed directly so that its end of line flag is preserved. 
+     */
+    void AnsiTerminal::appendToGrapheme(char32_t codepoint) {
+        Cell * cell = previousCharacter();
+        if (cell == nullptr)
+            return;
+        std::u32string cluster{state_->buffer.codepoints(*cell)};
+        cluster.push_back(codepoint);
+        collectGraphemes();
+        char32_t id = state_->buffer.graphemes().intern(cluster);
+        if (id != Canvas::GraphemeTable::Invalid)
+            cell->setGrapheme(id);
+    }
+
+    void AnsiTerminal::collectGraphemes() {
+        Canvas::GraphemeTable & graphemes = state_->buffer.graphemes();
+        if (! graphemes.needsCollection())
+            return;
+        std::vector<bool> used;
+        state_->buffer.markGraphemes(used);
+        stateBackup_->buffer.markGraphemes(used);
+        history_.markGraphemes(used);
+        graphemes.collect(used);
+    }
+
+    /** Unlike parseCodepoint(), the cursor position is only updated once per each row the text spans and the cells are written directly to the buffer's rows. 
+     */
+    void AnsiTerminal::parseASCII(char const * begin, char const * end) {
+        LOG(SEQ) << "text " << std::string{begin, end};
+        while (begin != end) {
+            updateCursorPosition();
+            Point pos = cursorPosition();
+            int n = std::min(static_cast<int>(end - begin), state_->buffer.width() - pos.x());
+            Cell * row = state_->buffer.row(pos.y()) + pos.x();
+            for (int i = 0; i < n; ++i) {
+                char32_t codepoint = static_cast<unsigned char>(begin[i]);
+                if (lineDrawingSet_ && codepoint >= 0x6a && codepoint < 0x79)
+                    codepoint = LineDrawingChars_[codepoint-0x6a];
+                Cell & cell = row[i];
+                cell = state_->cell;
+                if (inProgressHyperlink_ != nullptr)
+                    cell.attachSpecialObject(inProgressHyperlink_);
+                cell.setCodepoint(codepoint);
+            }
+            begin += n;
+            state_->setLastCharacter(Point{pos.x() + n - 1, pos.y()});
+            setCursorPosition(Point{pos.x() + n, pos.y()});
+        }
+    }
+
+    void AnsiTerminal::parseControlCharacter(char c) {
+        switch (c) {
+            /* BEL triggers the notification */
+            case Char::BEL:
+                parseNotification();
+                break;
+            case Char::TAB:
+                parseTab();
+                break;
+            case Char::LF:
+                parseLF();
+                break;
+            case Char::CR:
+                parseCR();
+                break;
+            case Char::BACKSPACE:
+                parseBackspace();
+                break;
+            default:
+                UNREACHABLE;
+        }
+    }
+
     void AnsiTerminal::parseNotification() {
         schedule([this](){
             VoidEvent::Payload p;
@@ -772,7 +984,6 @@ namespace ui {
     }
 
     void AnsiTerminal::parseTab() {
-        resetHyperlinkDetection();
         updateCursorPosition();
         if (cursorPosition().x() % 8 == 0)
             setCursorPosition(cursorPosition() + Point{8, 0});
@@ -783,7 +994,6 @@ namespace ui {
 
     void AnsiTerminal::parseLF() {
         LOG(SEQ) << "LF";
-        resetHyperlinkDetection();
         state_->markLineEnd();
         // disable double width and height chars
         state_->cell.font().setSize(1).setDoubleWidth(false);
@@ -799,7 +1009,6 @@ namespace ui {
 
     void AnsiTerminal::parseCR() {
         LOG(SEQ) << "CR";
-        resetHyperlinkDetection();
         // mark the last character as line end?
         // TODO
         setCursorPosition(Point{0, cursorPosition().y()});
@@ -807,7 +1016,6 @@ namespace ui {
 
     void AnsiTerminal::parseBackspace() {
         LOG(SEQ) << "BACKSPACE";
-        resetHyperlinkDetection();
         if (cursorPosition().x() == 0) {
             if (cursorPosition().y() > 0)
                 setCursorPosition(cursorPosition() - Point{0, 1});
@@ -817,160 +1025,83 @@ namespace ui {
         }
     }
 
-    size_t AnsiTerminal::parseEscapeSequence(char const * buffer, char const * bufferEnd) {
-        ASSERT(*buffer == Char::ESC);
-        // if we have nothing after the escape character, it is incomplete sequence
-        char const * x = buffer;
-        if (++x == bufferEnd)
-            return 0;
-        switch (*x++) {
-            /* CSI Sequence. */
-            case '[': {
-                x -= 2;
-                CSISequence seq{CSISequence::Parse(x, bufferEnd)};
-                // if the sequence is not valid, it has been reported already and we should just exit
-                if (!seq.valid())
-                    break;
-                // if the sequence is not complete, return false and do not advance the buffer
-                if (!seq.complete())
-                    return false;
-                // otherwise parse the CSI sequence
-                parseCSISequence(seq);
+    void AnsiTerminal::parseEscapeSequence(char intermediate, char finalByte) {
+        switch (intermediate) {
+            case 0:
                 break;
-            }
-            /* OSC (Operating System Command) */
-            case ']': {
-                x -= 2;
-                OSCSequence seq{OSCSequence::Parse(x, bufferEnd)};
-                // if the sequence is not valid, it has been reported already and we should just exit
-                if (!seq.valid())
-                    break;
-                // if the sequence is not complete, return false and do not advance the buffer
-                if (!seq.complete())
-                    return false;
-                parseOSCSequence(seq);
-				break;
-            }
-			/* Save Cursor. */
-			case '7':
-				LOG(SEQ) << "DECSC: Cursor position saved";
-                resetHyperlinkDetection();
+            /* Character set specification - most cases are ignored, with the exception of the box drawing and reset to english (0 and B) respectively.
+             */
+            case '(':
+                if (finalByte == '0') {
+                    lineDrawingSet_ = true;
+                    LOG(SEQ) << "Line drawing set selected";
+                    return;
+                } else if (finalByte == 'B') {
+                    lineDrawingSet_ = false;
+                    LOG(SEQ) << "Normal character set selected";
+                    return;
+                }
+                [[fallthrough]]; // fallthrough
+            case ')':
+            case '*':
+            case '+':
+                if (finalByte == 'B') // US
+                    return;
+                LOG(SEQ_WONT_SUPPORT) << "Unknown (possibly mismatched) character set final char " << finalByte;
+                return;
+            default:
+                LOG(SEQ_UNKNOWN) << "Unknown escape sequence \x1b" << intermediate << finalByte;
+                return;
+        }
+        switch (finalByte) {
+            /* Save Cursor. */
+            case '7':
+                LOG(SEQ) << "DECSC: Cursor position saved";
                 state_->saveCursor();
-				break;
-			/* Restore Cursor. */
-			case '8':
+                break;
+            /* Restore Cursor. */
+            case '8':
                 LOG(SEQ) << "DECRC: Cursor position restored";
-                resetHyperlinkDetection();
                 state_->restoreCursor();
-				break;
-			/* Reverse line feed - move up 1 row, same column.
-			 */
-			case 'M':
-				LOG(SEQ) << "RI: move cursor 1 line up";
-                resetHyperlinkDetection();
-				if (cursorPosition().y() == state_->scrollStart)
-					insertLines(1, state_->scrollStart, state_->scrollEnd, state_->cell);
-				else
-                    setCursorPosition(cursorPosition() - Point{0, 1});
-				break;
-            /* Device Control String (DCS).
-             */
-            case 'P':
-                resetHyperlinkDetection();
-                if (x == bufferEnd)
-                    return false;
-                if (*x == '+') {
-                    resetHyperlinkDetection();
-                    // frees the UI thread to draw the buffer while we are dealing with the tpp sequence
-                    bufferLock_.unlock();
-                    size_t p = parseTppSequence(buffer, bufferEnd);
-                    bufferLock_.lock();
-                    return p;
-                } else {
-                    LOG(SEQ_UNKNOWN) << "Unknown DCS sequence";
-                }
                 break;
-    		/* Character set specification - most cases are ignored, with the exception of the box drawing and reset to english (0 and B) respectively.
+            /* Reverse line feed - move up 1 row, same column.
              */
-			case '(':
-                resetHyperlinkDetection();
-                if (x != bufferEnd) {
-                    if (*x == '0') {
-                        ++x;
-                        lineDrawingSet_ = true;
-                        LOG(SEQ) << "Line drawing set selected";
-                        break;
-                    } else if (*x == 'B') {
-                        ++x;
-                        lineDrawingSet_ = false;
-                        LOG(SEQ) << "Normal character set selected";
-                        break;
-                    }
-                }
-                [[fallthrough]]; // fallthrough
-			case ')':
-			case '*':
-			case '+':
-				// missing character set specification
-                resetHyperlinkDetection();
-				if (x == bufferEnd)
-					return false;
-				if (*x == 'B') { // US
-					++x;
-					break;
-				}
-				LOG(SEQ_WONT_SUPPORT) << "Unknown (possibly mismatched) character set final char " << *x;
-				++x;
-				break;
-			/* ESC = -- Application keypad */
-			case '=':
-				LOG(SEQ) << "Application keypad mode enabled";
-                resetHyperlinkDetection();
+            case 'M':
+                LOG(SEQ) << "RI: move cursor 1 line up";
+                if (cursorPosition().y() == state_->scrollStart)
+                    insertLines(1, state_->scrollStart, state_->scrollEnd, state_->cell);
+                else
+                    setCursorPosition(cursorPosition() - Point{0, 1});
+                break;
+            /* ESC = -- Application keypad */
+            case '=':
+                LOG(SEQ) << "Application keypad mode enabled";
                 keypadMode_ = KeypadMode::Application;
-				break;
-			/* ESC > -- Normal keypad */
-			case '>':
-				LOG(SEQ) << "Normal keypad mode enabled";
-                resetHyperlinkDetection();
+                break;
+            /* ESC > -- Normal keypad */
+            case '>':
+                LOG(SEQ) << "Normal keypad mode enabled";
                 keypadMode_ = KeypadMode::Normal;
-				break;
-            /* ESC # number -- font size changes */
-            /*
-            case '#':
-                if (x == bufferEnd)
-                    return false;
-                parseFontSizeSpecifier(*x);
-                ++x;
                 break;
-                */
             default:
-                resetHyperlinkDetection();
-				LOG(SEQ_UNKNOWN) << "Unknown escape sequence \x1b" << *(x-1);
-				break;
+                LOG(SEQ_UNKNOWN) << "Unknown escape sequence \x1b" << finalByte;
+                break;
         }
-        return x - buffer;
     }
 
-    size_t AnsiTerminal::parseTppSequence(char const * buffer, char const * bufferEnd) {
-        // we know that we have at least \033P+
-        char const * i = buffer + 3;
-        char const * tppEnd = tpp::Sequence::FindSequenceEnd(i, bufferEnd);
-        // if not found, we need more data
-        if (tppEnd == bufferEnd)
-            return 0;
-        tpp::Sequence::Kind kind = tpp::Sequence::ParseKind(i, bufferEnd);
+    void AnsiTerminal::parseTppSequence(char const * payload, char const * payloadEnd) {
+        ASSERT(*payloadEnd == Char::BEL);
+        // frees the UI thread to draw the buffer while we are dealing with the tpp sequence
+        bufferLock_.unlock();
+        tpp::Sequence::Kind kind = tpp::Sequence::ParseKind(payload, payloadEnd + 1);
         // now we have kind and beginning and end of the payload so we can process the sequence
-        LOG(SEQ) << "t++ sequence " << kind << ", payload size " << (tppEnd - i);
+        LOG(SEQ) << "t++ sequence " << kind << ", payload size " << (payloadEnd - payload);
         // processes the tpp sequence, the default implementation simply raises the tpp sequence event
-        tppSequence(TppSequenceEvent::Payload{kind, i, tppEnd});
-        // and return
-        return (tppEnd - buffer) + 1; // also process the BEL character at the end of the t++ sequence
+        tppSequence(TppSequenceEvent::Payload{kind, payload, payloadEnd});
+        bufferLock_.lock();
     }
 
     void AnsiTerminal::parseCSISequence(CSISequence & seq) {
-        // reset hyperlink detection for all but SGR commands
-        if (seq.firstByte() != 0 || seq.finalByte() != 'm')
-            resetHyperlinkDetection();
         // process the sequence
         switch (seq.firstByte()) {
             // the "normal" CSI sequences
@@ -1426,11 +1557,11 @@ namespace ui {
                             if (alternateMode_)
                                 setScrollOffset(Point{0, 0});
                             else
-                                setScrollOffset(Point{0, static_cast<int>(historyRows_.size())});
+                                setScrollOffset(Point{0, history_.size()});
                         });
                         // if we are entering the alternate mode, reset the state to default values
                         if (value) {
-                            state_->reset(palette_.defaultForeground(), palette_.defaultBackground());
+                            state_->reset(Palette::Indexed(Palette::DEFAULT_FG), Palette::Indexed(Palette::DEFAULT_BG));
                             state_->invalidateLastCharacter();
                             LOG(SEQ) << "Alternate mode on";
                         } else {
@@ -1458,12 +1589,15 @@ namespace ui {
     void AnsiTerminal::parseSGR(CSISequence & seq) {
         seq.setDefault(0, 0);
 		for (size_t i = 0; i < seq.numArgs(); ++i) {
+            // sub-parameters not consumed by their attribute are not supported
+            if (seq.isSubParameter(i))
+                continue;
 			switch (seq[i]) {
 				/* Resets all attributes. */
 				case 0:
-                    state_->cell.setFg(palette_.defaultForeground())
-                               .setDecor(palette_.defaultForeground())
-                               .setBg(palette_.defaultBackground())
+                    state_->cell.setFg(Palette::Indexed(Palette::DEFAULT_FG))
+                               .setDecor(Palette::Indexed(Palette::DEFAULT_FG))
+                               .setBg(Palette::Indexed(Palette::DEFAULT_BG))
                                .setFont(Font{});
                     state_->bold = false;
                     state_->inverseMode = false;
@@ -1562,8 +1696,8 @@ namespace ui {
                 }
 				/* Foreground default. */
 				case 39:
-                    state_->cell.setFg(palette_.defaultForeground())
-                               .setDecor(palette_.defaultForeground());
+                    state_->cell.setFg(Palette::Indexed(Palette::DEFAULT_FG))
+                               .setDecor(Palette::Indexed(Palette::DEFAULT_FG));
 					LOG(SEQ) << "fg reset";
 					break;
 				/* 40 - 47 are dark background color, handled in the default case. */
@@ -1576,7 +1710,7 @@ namespace ui {
                 }
 				/* Background default */
 				case 49:
-					state_->cell.setBg(palette_.defaultBackground());
+					state_->cell.setBg(Palette::Indexed(Palette::DEFAULT_BG));
 					LOG(SEQ) << "bg reset";
 					break;
 				/* 90 - 97 are bright foreground colors, handled in the default case. */
@@ -1586,19 +1720,19 @@ namespace ui {
                         int colorIndex = seq[i] - 30;
                         if (boldIsBright_ && state_->bold)
                             colorIndex += 8;
-						state_->cell.setFg(palette_.at(colorIndex))
-                                   .setDecor(palette_.at(colorIndex));
-						LOG(SEQ) << "fg set to " << palette_.at(seq[i] - 30);
+						state_->cell.setFg(Palette::Indexed(colorIndex))
+                                   .setDecor(Palette::Indexed(colorIndex));
+						LOG(SEQ) << "fg set to " << colorIndex;
 					} else if (seq[i] >= 40 && seq[i] <= 47) {
-						state_->cell.setBg(palette_.at(seq[i] - 40));
-						LOG(SEQ) << "bg set to " << palette_.at(seq[i] - 40);
+						state_->cell.setBg(Palette::Indexed(seq[i] - 40));
+						LOG(SEQ) << "bg set to " << (seq[i] - 40);
 					} else if (seq[i] >= 90 && seq[i] <= 97) {
-						state_->cell.setFg(palette_.at(seq[i] - 82))
-                                   .setDecor(palette_.at(seq[i] - 82));
-						LOG(SEQ) << "fg set to " << palette_.at(seq[i] - 82);
+						state_->cell.setFg(Palette::Indexed(seq[i] - 82))
+                                   .setDecor(Palette::Indexed(seq[i] - 82));
+						LOG(SEQ) << "fg set to " << (seq[i] - 82);
 					} else if (seq[i] >= 100 && seq[i] <= 107) {
-						state_->cell.setBg(palette_.at(seq[i] - 92));
-						LOG(SEQ) << "bg set to " << palette_.at(seq[i] - 92);
+						state_->cell.setBg(Palette::Indexed(seq[i] - 92));
+						LOG(SEQ) << "bg set to " << (seq[i] - 92);
 					} else {
 						LOG(SEQ_UNKNOWN) << "Invalid SGR code: " << seq;
 					}
@@ -1609,6 +1743,28 @@ namespace ui {
 
     Color AnsiTerminal::parseSGRExtendedColor(CSISequence & seq, size_t & i) {
 		++i;
+        // colon separated form, i.e. 38:5:index, or 38:2:[colorspace]:r:g:b where the colorspace id may be omitted
+        if (seq.isSubParameter(i)) {
+            size_t end = i + 1;
+            while (seq.isSubParameter(end))
+                ++end;
+            size_t n = end - i;
+            Color result = Color::White;
+            bool valid = false;
+            if (seq[i] == 5 && n == 2) {
+                valid = seq[i + 1] <= 255;
+                if (valid)
+                    result = Palette::Indexed(seq[i + 1]);
+            } else if (seq[i] == 2 && (n == 4 || n == 5)) {
+                valid = seq[end - 3] <= 255 && seq[end - 2] <= 255 && seq[end - 1] <= 255;
+                if (valid)
+                    result = Color(seq[end - 3] & 0xff, seq[end - 2] & 0xff, seq[end - 1] & 0xff);
+            }
+            i = end - 1;
+            if (!valid)
+                LOG(SEQ_UNKNOWN) << "Invalid extended color: " << seq;
+            return result;
+        }
 		if (i < seq.numArgs()) {
 			switch (seq[i++]) {
 				/* index from 256 colors */
@@ -1617,7 +1773,7 @@ namespace ui {
 						break;
 					if (seq[i] > 255) // invalid color spec
 						break;
-                    return palette_.at(seq[i]);
+                    return Palette::Indexed(seq[i]);
 				/* true color rgb */
 				case 2:
 					i += 2;
@@ -1645,7 +1801,7 @@ namespace ui {
                 if (seq.numArgs() != 1)
                     break;
     			LOG(SEQ) << "Title change to " << seq[0];
-                schedule([this, title = seq[0]](){
+                schedule([this, title = std::string{seq[0]}](){
                     StringEvent::Payload p{title};
                     onTitleChange(p, this);
                 });
@@ -1674,7 +1830,7 @@ namespace ui {
                             if (inProgressHyperlink_ != nullptr)
                                 LOG(SEQ_ERROR) << "Unterminaled hyperlink to url " << inProgressHyperlink_->url();
                             LOG(SEQ) << "hyperlink to " << seq[1];
-                            inProgressHyperlink_ = new Hyperlink(seq[1], normalHyperlinkStyle_, activeHyperlinkStyle_);
+                            inProgressHyperlink_ = new Hyperlink(std::string{seq[1]}, normalHyperlinkStyle_, activeHyperlinkStyle_);
                         } else {
                             if (inProgressHyperlink_ == nullptr)
                             LOG(SEQ_ERROR) << "Hyperlink terminated wiothout active one";
@@ -1686,20 +1842,56 @@ namespace ui {
                 // hyperlinks with different number of arguments are invalid sequences
                 break;
             }
+            /* OSC 4 - set or query palette colors, i.e. `OSC 4 ; index ; spec [; index ; spec ...] ST`.
+
+               The palette is resolved when painted, so the change applies to all cells immediately.
+             */
+            case 4: {
+                if (seq.numArgs() < 2)
+                    break;
+                // the last value contains the rest of the payload if there are more values than the sequence keeps
+                std::vector<std::string_view> values;
+                for (size_t i = 0; i < seq.numArgs(); ++i)
+                    values.push_back(seq[i]);
+                for (size_t sep = values.back().find(';'); sep != std::string_view::npos; sep = values.back().find(';')) {
+                    std::string_view rest = values.back().substr(sep + 1);
+                    values.back() = values.back().substr(0, sep);
+                    values.push_back(rest);
+                }
+                parseOSCPalette(values);
+                return;
+            }
             /* OSC 52 - set clipboard to given value.
              */
             case 52: {
                 if (seq.numArgs() == 2 && seq[0] == "c") {
-                    std::string text = seq[1];
-                    LOG(SEQ) << "Clipboard set to " << text;
-                    schedule([this, contents = text]() {
-                        StringEvent::Payload p{contents};
+                    LOG(SEQ) << "Clipboard set to " << seq[1];
+                    // the payload is copied only once into the scheduled handler and then moved to the event
+                    schedule([this, contents = std::string{seq[1]}]() mutable {
+                        StringEvent::Payload p{std::move(contents)};
                         onClipboardSetRequest(p, this);
                     });
                     return;
                 }
                 break;
             }
+            /* OSC 104 - reset palette colors, either those given, or the whole palette if there are none.
+             */
+            case 104: {
+                if (seq.numArgs() == 0 || (seq.numArgs() == 1 && seq[0].empty())) {
+                    LOG(SEQ) << "Palette reset";
+                    palette_ = initialPalette_;
+                    return;
+                }
+                for (size_t i = 0; i < seq.numArgs(); ++i) {
+                    size_t index = ParsePaletteIndex(seq[i]);
+                    if (index < palette_.size() && index < initialPalette_.size())
+                        palette_.setColor(index, initialPalette_[index]);
+                    else
+                        LOG(SEQ_UNKNOWN) << "Invalid palette color reset: " << seq;
+                }
+                return;
+            }
             /* OSC 112 - reset cursor color.
              */
             case 112:
@@ -1713,19 +1905,121 @@ namespace ui {
         LOG(SEQ_UNKNOWN) << "Invalid OSC sequence: " << seq;
     }
 
+    void AnsiTerminal::parseOSCPalette(std::vector<std::string_view> const & values) {
+        for (size_t i = 0; i + 1 < values.size(); i += 2) {
+            size_t index = ParsePaletteIndex(values[i]);
+            if (index >= palette_.size()) {
+                LOG(SEQ_UNKNOWN) << "Invalid palette index " << values[i];
+                continue;
+            }
+            if (values[i + 1] == "?") {
+                Color c = palette_[index];
+                // the channels are reported with 16 bits as xterm does
+                std::string reply = STR("\033]4;" << index << ";rgb:" << std::hex << std::setfill('0')
+                    << std::setw(4) << (c.r * 257) << "/" << std::setw(4) << (c.g * 257) << "/" << std::setw(4) << (c.b * 257) << "\033\\");
+                LOG(SEQ) << "Palette color " << index << " query";
+                send(reply.c_str(), reply.size());
+                continue;
+            }
+            Color color;
+            if (ParseColorSpec(values[i + 1], color)) {
+                LOG(SEQ) << "Palette color " << index << " set to " << color;
+                palette_.setColor(index, color);
+            } else {
+                LOG(SEQ_UNKNOWN) << "Invalid color specification " << values[i + 1];
+            }
+        }
+    }
+
+    size_t AnsiTerminal::ParsePaletteIndex(std::string_view value) {
+        if (value.empty() || value.size() > 3)
+            return Palette::MAX_COLORS;
+        size_t result = 0;
+        for (char c : value) {
+            if (! IsDecimalDigit(c))
+                return Palette::MAX_COLORS;
+            result = result * 10 + DecCharToNumber(c);
+        }
+        return result;
+    }
+
+    bool AnsiTerminal::ParseColorSpec(std::string_view spec, Color & result) {
+        unsigned char channels[3];
+        if (spec.size() == 7 && spec[0] == '#') {
+            for (size_t i = 0; i < 3; ++i) {
+                if (! IsHexadecimalDigit(spec[i * 2 + 1]) || ! IsHexadecimalDigit(spec[i * 2 + 2]))
+                    return false;
+                channels[i] = static_cast<unsigned char>(HexCharToNumber(spec[i * 2 + 1]) * 16 + HexCharToNumber(spec[i * 2 + 2]));
+            }
+        } else if (spec.substr(0, 4) == "rgb:") {
+            spec.remove_prefix(4);
+            for (size_t i = 0; i < 3; ++i) {
+                size_t end = (i == 2) ? spec.size() : spec.find('/');
+                if (end == 0 || end > 4 || end == std::string_view::npos)
+                    return false;
+                unsigned value = 0;
+                for (size_t j = 0; j < end; ++j) {
+                    if (! IsHexadecimalDigit(spec[j]))
+                        return false;
+                    value = value * 16 + HexCharToNumber(spec[j]);
+                }
+                // scale the value of given number of hex digits to 8 bits
+                channels[i] = static_cast<unsigned char>(value * 255 / ((1u << (4 * end)) - 1));
+                spec.remove_prefix(std::min(spec.size(), end + 1));
+            }
+        } else {
+            return false;
+        }
+        result = Color{channels[0], channels[1], channels[2]};
+        return true;
+    }
+
+    void AnsiTerminal::parseOSCStreamStart(OSCSequence & seq) {
+        streamingClipboard_ = (seq.num() == 52 && seq.numArgs() == 1 && seq[0] == "c");
+        streamedClipboard_.clear();
+        if (! streamingClipboard_)
+            LOG(SEQ_UNKNOWN) << "Oversized OSC sequence ignored: " << seq;
+    }
+
+    void AnsiTerminal::parseOSCStreamData(char const * data, char const * dataEnd) {
+        if (! streamingClipboard_)
+            return;
+        if (streamedClipboard_.size() + (dataEnd - data) > MAX_PAYLOAD_SIZE) {
+            LOG(SEQ_ERROR) << "Clipboard contents too large, ignored";
+            streamingClipboard_ = false;
+            streamedClipboard_ = std::string{};
+            return;
+        }
+        streamedClipboard_.append(data, dataEnd);
+    }
+
+    void AnsiTerminal::parseOSCStreamEnd() {
+        if (! streamingClipboard_)
+            return;
+        streamingClipboard_ = false;
+        LOG(SEQ) << "Clipboard set to " << streamedClipboard_.size() << " bytes";
+        schedule([this, contents = std::move(streamedClipboard_)]() mutable {
+            StringEvent::Payload p{std::move(contents)};
+            onClipboardSetRequest(p, this);
+        });
+        streamedClipboard_ = std::string{};
+    }
+
 
 
     // ============================================================================================
     // AnsiTerminal::Buffer
 
-    void AnsiTerminal::Buffer::insertLine(int top, int bottom, Cell const & fill) {
-        Cell * x = rows_[bottom - 1];
-        memmove(rows_ + top + 1, rows_ + top, sizeof(Cell*) * (bottom - top - 1));
-        rows_[top] = x;
-        fillRow(top, fill, 0, width());
+    void AnsiTerminal::Buffer::insertLines(int lines, int top, int bottom, Cell const & fill) {
+        lines = std::min(lines, bottom - top);
+        if (lines <= 0)
+            return;
+        scrollRows(top, bottom, -lines);
+        for (int row = top, e = top + lines; row < e; ++row)
+            fillRow(row, fill, 0, width());
     }
 
-    std::pair<AnsiTerminal::Cell *, int> AnsiTerminal::Buffer::copyRow(int row, Color defaultBg) {
+    int AnsiTerminal::Buffer::historyRowLength(int row, Color defaultBg) {
         int lastCol = width();
         Cell * x = rows_[row];
         while (lastCol-- > 0) {
@@ -1734,39 +2028,38 @@ namespace ui {
             if (IsLineEnd(c))
                 break;
             // if we have found a visible character, we must remember the whole line, break the search - any end of line characters left of it will make no difference
-            if (c.codepoint() != ' ' || c.bg() != defaultBg || c.font().underline() || c.font().strikethrough()) {
+            if (c.codepoint() != ' ' || c.isGrapheme() || c.bg() != defaultBg || c.font().underline() || c.font().strikethrough()) {
                 break;
             }
         }
         // if we are not at the end of line, we must remember the whole line
-        if (IsLineEnd(x[lastCol]))
-            lastCol += 1;
+        if (lastCol >= 0 && IsLineEnd(x[lastCol]))
+            return lastCol + 1;
         else
-            lastCol = width();
-        // make the copy and return it
-        Cell * result = new Cell[lastCol];
-        // we cannot use memcopy here because the cells can be special
-        MemCopy(result, x, lastCol);
-        return std::make_pair(result, lastCol);
+            return width();
     }
 
-    void AnsiTerminal::Buffer::deleteLine(int top, int bottom, Cell const & fill) {
-        Cell * x = rows_[top];
-        memmove(rows_ + top, rows_ + top + 1, sizeof(Cell*) * (bottom - top - 1));
-        rows_[bottom - 1] = x;
-        fillRow(bottom - 1, fill, 0, width());
+    void AnsiTerminal::Buffer::deleteLines(int lines, int top, int bottom, Cell const & fill) {
+        lines = std::min(lines, bottom - top);
+        if (lines <= 0)
+            return;
+        scrollRows(top, bottom, lines);
+        for (int row = bottom - lines; row < bottom; ++row)
+            fillRow(row, fill, 0, width());
     }
 
-    void AnsiTerminal::Buffer::resize(Size size, Cell const & fill, std::function<void(Cell*, int)> addToHistory) {
+    void AnsiTerminal::Buffer::resize(Size size, Cell const & fill, std::function<void(Cell const *, int)> addToHistory) {
         if (size_ == size)
             return;
         // determine the line at which the cursor is, which can span multiple terminal lines if it is wrapped. This is important because the contents of the cursor line and all lines below is not being copied to the resized buffer as it should be rewritten by the terminal app
         int stopRow = getCursorRowWrappedStart();
         // first keep the old rows and size so that we can copy the data from it
+        Cell ** oldRing = ring_;
         Cell ** oldRows = rows_;
         int oldWidth = width();
         int oldHeight = height();
         // move the old rows out and call basic buffer resize to adjust width and height, fill the buffer with given cell so that we do not have to deal with uninitialized cells later.
+        ring_ = nullptr;
         rows_ = nullptr;
         Canvas::Buffer::resize(size);
         this->fill(fill);
@@ -1792,8 +2085,8 @@ namespace ui {
         adjustCursorPosition(fill, addToHistory);
         // and delete the old rows
         for (int i = 0; i < oldHeight; ++i)
-            delete [] oldRows[i];
-        delete [] oldRows;
+            delete [] oldRing[i];
+        delete [] oldRing;
     }
 
     /** The algorithm is simple. Start at the row one above current cursor position. Then if we find an end of line character on that row, we know the next row was the first line of the cursor. If there is no end of line character, then the line is wordwrapped to the line after it so we check the line above, or if we get all the way to the top of the buffer its the first line by definition.
@@ -1812,25 +2105,22 @@ namespace ui {
         return row + 1;
     }
 
-    void AnsiTerminal::Buffer::adjustCursorPosition(Cell const & fill, std::function<void(Cell*, int)> addToHistory) {
+    void AnsiTerminal::Buffer::adjustCursorPosition(Cell const & fill, std::function<void(Cell const *, int)> addToHistory) {
         // first make sure that the position where we enter the cell is valid
         if (cursorPosition_.x() >= width())
             cursorPosition_ = Point{0, cursorPosition_.y() + 1};
         // if the y coordinate is outside the buffer, we will be scrolling one line up
         if (cursorPosition_.y() >= height()) {
-            if (addToHistory) {
-                Cell * rowCopy = new Cell[width()];
-                MemCopy(rowCopy, rows_[0], width());
-                addToHistory(rowCopy, width());
-            }
-            deleteLine(0, height(), fill);
+            if (addToHistory)
+                addToHistory(rows_[0], width());
+            deleteLines(1, 0, height(), fill);
             cursorPosition_ -= Point{0,1};
         }
     }
 
     bool AnsiTerminal::Buffer::hasOnlyWhitespace(Cell * row, int from, int width) {
         for (; from < width; ++from)
-            if (!Char::IsWhitespace(row[from].codepoint()))
+            if (row[from].isGrapheme() || !Char::IsWhitespace(row[from].codepoint()))
                 return false;
         return true;
     }
@@ -1907,55 +2197,10 @@ namespace ui {
     }
 
     AnsiTerminal::Palette::Palette(std::initializer_list<Color> colors, Color defaultFg, Color defaultBg):
-        size_(colors.size()),
-        defaultFg_(defaultFg),
-        defaultBg_(defaultBg),
-        colors_(new Color[colors.size()]) {
+        Palette(colors.size(), defaultFg, defaultBg) {
 		unsigned i = 0;
 		for (Color c : colors)
 			colors_[i++] = c;
     }
 
-    AnsiTerminal::Palette::Palette(Palette const & from):
-        size_(from.size_),
-        defaultFg_(from.defaultFg_),
-        defaultBg_(from.defaultBg_),
-        colors_(new Color[from.size_]) {
-		memcpy(colors_, from.colors_, sizeof(Color) * size_);
-    }
-
-    AnsiTerminal::Palette::Palette(Palette && from) noexcept:
-        size_(from.size_),
-        defaultFg_(from.defaultFg_),
-        defaultBg_(from.defaultBg_),
-        colors_(from.colors_) {
-        from.colors_ = nullptr;
-        from.size_ = 0;
-    }
-
-    AnsiTerminal::Palette & AnsiTerminal::Palette::operator = (AnsiTerminal::Palette const & other) {
-        if (&other != this) {
-            delete [] colors_;
-            size_ = other.size_;
-            defaultFg_ = other.defaultFg_;
-            defaultBg_ = other.defaultBg_;
-            colors_ = new Color[size_];
-    		memcpy(colors_, other.colors_, sizeof(Color) * size_);
-        }
-        return *this;
-    }
-
-    AnsiTerminal::Palette & AnsiTerminal::Palette::operator == (AnsiTerminal::Palette && other) {
-        if (&other != this) {
-            delete [] colors_;
-            size_ = other.size_;
-            defaultFg_ = other.defaultFg_;
-            defaultBg_ = other.defaultBg_;
-            colors_ = other.colors_;
-            other.colors_ = nullptr;
-            other.size_ = 0;
-        }
-        return *this;
-    }
-
 } // namespace ui
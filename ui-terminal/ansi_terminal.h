@@ -1,5 +1,6 @@
 #pragma once
 
+#include <chrono>
 #include <unordered_map>
 #include <unordered_set>
 
@@ -13,7 +14,9 @@
 
 #include "csi_sequence.h"
 #include "osc_sequence.h"
+#include "terminal_history.h"
 #include "url_matcher.h"
+#include "vt_parser.h"
 
 namespace ui {
 
@@ -32,76 +35,75 @@ namespace ui {
      
         The simplest interface to the rerminal, no history, selection, etc?
      */
-    class AnsiTerminal : public virtual Widget, public tpp::PTYBuffer<tpp::PTYMaster>, SelectionOwner {
+    class AnsiTerminal : public virtual Widget, public tpp::PTYBuffer<tpp::PTYMaster>, SelectionOwner, VTParser {
     public:
         using Cell = Canvas::Cell;
+        using PackedCell = Canvas::PackedCell;
         using Cursor = Canvas::Cursor;
         class Buffer;
         class State;
 
         /** Palette
+
+            The colors are stored inline, together with the default foreground and background colors, which follow the palette colors so that all of them can be referred to by their index. 
+
+            Cells of the terminal do not store the palette colors themselves, but references to their indices (see Indexed()), which are resolved when the terminal is painted. Changes to the palette therefore apply to the whole terminal contents, including the history, without rewriting any cells. 
          */
         class Palette {
         public:
 
+            /** Maximum number of colors in the palette. 
+             */
+            static constexpr size_t MAX_COLORS = 256;
+
+            /** Indices of the default foreground and background colors. 
+             */
+            static constexpr size_t DEFAULT_FG = MAX_COLORS;
+            static constexpr size_t DEFAULT_BG = MAX_COLORS + 1;
+
             static Palette Colors16();
             static Palette XTerm256(); 
 
             Palette():
-                size_{2},
-                defaultFg_{Color::White},
-                defaultBg_{Color::Black},
-                colors_{new Color[2]} {
-                colors_[0] = Color::Black;
-                colors_[1] = Color::White;
+                Palette{{Color::Black, Color::White}} {
             }
 
             Palette(size_t size, Color defaultFg = Color::White, Color defaultBg = Color::Black):
-                size_(size),
-                defaultFg_(defaultFg),
-                defaultBg_(defaultBg),
-                colors_(new Color[size]) {
+                size_{size} {
+                ASSERT(size <= MAX_COLORS);
+                std::fill(colors_, colors_ + MAX_COLORS, Color::White);
+                colors_[DEFAULT_FG] = defaultFg;
+                colors_[DEFAULT_BG] = defaultBg;
             }
 
             Palette(std::initializer_list<Color> colors, Color defaultFg = Color::White, Color defaultBg = Color::Black);
 
-            Palette(Palette const & from);
-
-            Palette(Palette && from) noexcept;
-
-            ~Palette() {
-                delete [] colors_;
-            }
-
-            Palette & operator = (Palette const & other);
-            Palette & operator == (Palette && other);
-
             size_t size() const {
                 return size_;
             }
 
             Color defaultForeground() const {
-                return defaultFg_;
+                return colors_[DEFAULT_FG];
             }
 
             Color defaultBackground() const {
-                return defaultBg_;
+                return colors_[DEFAULT_BG];
             }
 
             void setDefaultForeground(size_t index) {
-                defaultFg_ = colors_[index];
+                colors_[DEFAULT_FG] = colors_[index];
             }
 
             void setDefaultForeground(Color color) {
-                defaultFg_ = color;
+                colors_[DEFAULT_FG] = color;
             }
 
             void setDefaultBackground(size_t index) {
-                defaultBg_ = colors_[index];
+                colors_[DEFAULT_BG] = colors_[index];
             }
 
             void setDefaultBackground(Color color) {
-                defaultBg_ = color;
+                colors_[DEFAULT_BG] = color;
             }
 
             void setColor(size_t index, Color color) {
@@ -126,12 +128,33 @@ namespace ui {
                 return (*this)[index];
             }
 
+            /** Returns color that refers to the palette color of given index, or to the default colors. 
+             
+                The reference is encoded as a fully transparent color with the index in its red and green channels and a marker in the blue channel. Terminal cells never contain transparent colors otherwise.
+             */
+            static Color Indexed(size_t index) {
+                ASSERT(index <= DEFAULT_BG);
+                return Color{static_cast<unsigned char>(index & 0xff), static_cast<unsigned char>(index >> 8), INDEXED, 0};
+            }
+
+            static bool IsIndexed(Color color) {
+                return color.a == 0 && color.b == INDEXED;
+            }
+
+            /** Returns the actual value of the color, which may refer to the palette. 
+             
+                References to colors outside of the palette's size resolve to white. 
+             */
+            Color resolve(Color color) const {
+                return IsIndexed(color) ? colors_[color.r + (color.g << 8)] : color;
+            }
+
         private:
 
+            static constexpr unsigned char INDEXED = 0xa5;
+
             size_t size_;
-            Color defaultFg_;
-            Color defaultBg_;
-            Color * colors_;
+            Color colors_[MAX_COLORS + 2];
 
         }; // AnsiTerminal::Palette
 
@@ -139,7 +162,15 @@ namespace ui {
      */
     //@{
     public:
-        static Log SEQ;
+        /** Traces every parsed character and sequence. 
+         
+            Since the trace is on the hot path, it is compiled out entirely unless the TRACE_SEQUENCES build option is enabled. 
+         */
+#if (defined TRACE_SEQUENCES)
+        static StaticLog<true> SEQ;
+#else
+        static StaticLog<false> SEQ;
+#endif
         static Log SEQ_UNKNOWN;
         static Log SEQ_ERROR;
         static Log SEQ_WONT_SUPPORT;
@@ -147,7 +178,11 @@ namespace ui {
     //@}
 
     public:
-        AnsiTerminal(tpp::PTYMaster * pty, Palette && palette);
+        /** Creates the terminal attached to given PTY. 
+         
+            If a recorder is given, all output of the PTY and the terminal resizes are recorded. The terminal takes ownership of both the PTY and the recorder. 
+         */
+        AnsiTerminal(tpp::PTYMaster * pty, Palette && palette, tpp::PTYRecorder * recorder = nullptr);
 
         ~AnsiTerminal() override;
 
@@ -162,7 +197,8 @@ namespace ui {
                 Widget::resize(size);
                 resizeHistory();
                 resizeBuffers(size);
-                pty_->resize(size.width(), size.height());
+                trimHistory();
+                resizePty(size.width(), size.height());
             }
             if (scrollToTerminal_)
                 setScrollOffset(Point{0, historyRows()});
@@ -174,6 +210,12 @@ namespace ui {
             return palette_;
         }
 
+        /** Changes the palette of the terminal. 
+         
+            The cells refer to the palette colors, which are resolved when painted, so only the palette itself is replaced and the terminal repainted. The palette also becomes the one to which OSC 104 resets the colors. 
+         */
+        void setPalette(Palette const & palette);
+
     /** \name Events
      */
 
@@ -208,7 +250,7 @@ namespace ui {
                 return Widget::contentsSize();
             } else {
                 std::lock_guard<PriorityLock> g(bufferLock_.priorityLock(), std::adopt_lock);
-                return Size{width(), height() + static_cast<int>(historyRows_.size())};
+                return Size{width(), height() + history_.size()};
             }
         }
 
@@ -337,7 +379,7 @@ namespace ui {
 
         The sequence creates the hyperlink, which is then attached to each next cell untiln the closing empty sequence is found. The size of the parameters or the link itself is not limited in any way on the terminal, but the maximum input buffer size will limit this in practice as the whole OSC sequence must fit in the buffer. 
 
-        When codepoints are sent to the terminal, they are matched continuously whether they match against an url, in which case a hyperlink is created and attached to the cells as well. 
+        Urls in the text are not detected when the text is parsed, but lazily when the rows are painted, or hovered over by mouse, so that output which is never displayed costs nothing. Each line of text is matched as a whole, including its rows wrapped over the terminal width, and a hyperlink is created and attached to the cells of every url found. The detected lines are remembered with a hash of their contents and only matched again when their contents change. 
 
         When mouse hovers over the cells with attached hyperlink, the link is highighted. When clicked, the onHyperlinkOpen event is triggered, which should open the link in a browser. On right button clicik, the onHyperlinkCopy event is triggered, which should copy the url to clipboard instead of opening. 
      */
@@ -370,7 +412,6 @@ namespace ui {
          */
         virtual void setDetectHyperlinks(bool value = true) {
             detectHyperlinks_ = value;
-            urlMatcher_.reset();
         }
 
         /** Returns the style used for new hyperlinks. 
@@ -406,28 +447,49 @@ namespace ui {
          */
         Hyperlink * hyperlinkAt(Point widgetCoords) {
             ASSERT(bufferLock_.locked());
-            Cell const * cell = cellAt(toContentsCoords(widgetCoords));
-            return cell == nullptr ? nullptr : dynamic_cast<Hyperlink*>(cell->specialObject());
+            Cell cell;
+            return cellAt(toContentsCoords(widgetCoords), cell) ? dynamic_cast<Hyperlink*>(cell.specialObject()) : nullptr;
         }
 
-        /** Resets the hyperlink detection matching. 
+        /** Detects hyperlinks in the lines of text that span given rows in contents coordinates. 
          
-            If the matching is in valid state, creates the hyperlink. The reset is done by adding an url separator character, which terminates the url scheme.
-
-            Any sequence other than SGR ones should reset the hyperlink matching.
+            The lines may extend up to MAX_URL_ROWS rows outside of the range so that urls wrapped over the range's boundaries are detected as well. 
          */
-        void resetHyperlinkDetection() {
-            detectHyperlink(' ');
-        }
+        void detectHyperlinks(int top, int bottom);
 
-        /** Adds given character to the url matcher. 
+        /** Detects hyperlinks in single line of text, which consists of given rows in contents coordinates, unless the line has not changed since its last detection. 
          
-            If adding the character makes a previously valid match invalid, creates the hyperlink and attaches it to its respective cells.
+            Hyperlinks detected previously are detached from the line's cells first. 
          */
-        void detectHyperlink(char32_t next);
+        void detectLineHyperlinks(int top, int bottom);
+
+        /** Returns the hash of the cells of given rows in contents coordinates, history rows are hashed as they are packed. 
+         */
+        size_t hyperlinkLineHash(int top, int bottom);
 
     private:
 
+        /** Hyperlink created by the automatic detection, so that it can be told apart from OSC 8 hyperlinks when the line is detected again. 
+         */
+        class DetectedHyperlink : public Hyperlink {
+        public:
+            using Hyperlink::Hyperlink;
+        }; 
+
+        /** Returns true if the given row in contents coordinates ends a line of text, i.e. is not wrapped to the next row. 
+         */
+        bool isLineEnd(int row);
+
+        /** Maximum number of rows outside of the detected range urls may span.
+         */
+        static constexpr int MAX_URL_ROWS = 4;
+
+        /** Hashes of the lines with detected hyperlinks, keyed by the absolute number of the line's first row, see TerminalHistory::firstRow(). 
+         
+            Rows of the buffer are numbered as if they followed the history, so that a line keeps its key when it scrolls to the history. The hashes are forgotten when the rows are numbered anew. 
+         */
+        std::unordered_map<size_t, size_t> hyperlinkLines_;
+
         /** When hyperlink is parsed, this holds the special object and the offset of the next cell. If the hyperlink in progress is nullptr, then there is no hyperlink in progress and hyperlink offset has no meaning. 
          */
         Hyperlink::Ptr inProgressHyperlink_;
@@ -436,10 +498,6 @@ namespace ui {
          */
         Hyperlink::Ptr activeHyperlink_;
 
-        /** Url matcher to detect hyperlinks in the terminal output automatically. 
-         */
-        UrlMatcher urlMatcher_;
-
         /** If true, OSC hyperlinks are supported. 
          */
         bool allowOSCHyperlinks_ = false;
@@ -505,6 +563,35 @@ namespace ui {
             allowCursorChanges_ = value;
         }
 
+        /** Returns the maximum number of bytes parsed at once. 
+         */
+        size_t parserSliceSize() const {
+            return parserSliceSize_;
+        }
+
+        /** Sets the maximum number of bytes parsed at once. 
+         
+            Between the slices the buffer lock is released if the UI thread waits for it, so that large amounts of input do not block painting and user input. 
+         */
+        void setParserSliceSize(size_t value) {
+            ASSERT(value > 0);
+            parserSliceSize_ = value;
+        }
+
+        /** Returns the number of bytes received per frame above which the terminal jump scrolls. 
+         */
+        size_t jumpScrollThreshold() const {
+            return jumpScrollThreshold_;
+        }
+
+        /** Sets the number of bytes received per frame above which the terminal jump scrolls, 0 disables jump scrolling. 
+         
+            When more than the threshold has been received since the last repaint and more input is already waiting to be processed, the terminal is flooded with output. The intermediate states are then not displayed and the view is updated at most once per frame, the state after the flood ends is always displayed. 
+         */
+        void setJumpScrollThreshold(size_t value) {
+            jumpScrollThreshold_ = value;
+        }
+
         Color inactiveCursorColor() const {
             return inactiveCursorColor_;
         }
@@ -528,7 +615,7 @@ namespace ui {
          */
         int historyRows() {
             std::lock_guard<PriorityLock> g{bufferLock_};
-            return static_cast<int>(historyRows_.size());
+            return history_.size();
         }
 
         int maxHistoryRows() const {
@@ -539,13 +626,108 @@ namespace ui {
             if (value != maxHistoryRows_) {
                 maxHistoryRows_ = std::max(value, 0);
                 std::lock_guard<PriorityLock> g{bufferLock_};
-                while (historyRows_.size() > static_cast<size_t>(maxHistoryRows_)) {
-                    delete [] historyRows_.front().second;
-                    historyRows_.pop_front();
-                }
+                trimHistory();
             }
         }
 
+        /** Moves the history that does not fit in given number of bytes of memory to the file, which is deleted when the terminal is destroyed.
+
+            Only the compressed history is moved, the rows recently added to the history are always kept in memory. Throws OSError if the file can't be created.
+         */
+        void setHistoryFile(std::string const & filename, size_t memoryLimit) {
+            std::lock_guard<PriorityLock> g{bufferLock_};
+            history_.setFile(filename, memoryLimit);
+        }
+
+        /** Memory the terminal occupies, in bytes. 
+         */
+        struct MemoryUsage {
+            /** Packed and compressed history rows kept in memory, the table of their styles and the buffers used to compress them. */
+            size_t history = 0;
+            /** Compressed history in the history file, which does not count as memory. */
+            size_t historyFile = 0;
+            /** Special objects, such as hyperlinks, referenced by the history and the buffers, each object counted once. */
+            size_t specialObjects = 0;
+            /** Cells of the normal and alternate buffers and the grapheme clusters they refer to. */
+            size_t buffers = 0;
+
+            size_t total() const {
+                return history + specialObjects + buffers;
+            }
+        }; 
+
+        /** Memory budget shared by multiple terminals. 
+         
+            Each terminal reports the memory it occupies to the budget whenever its history changes. When all the terminals together do not fit in the budget's limit, the terminal adding history rows deletes its oldest rows until it fits in the memory left by the other terminals. The budget must outlive the terminals that use it. 
+         */
+        class MemoryBudget {
+            friend class AnsiTerminal;
+        public:
+
+            /** Creates the budget of given limit in bytes, 0 for no limit. 
+             */
+            explicit MemoryBudget(size_t limit = 0):
+                limit_{limit} {
+            }
+
+            size_t limit() const {
+                return limit_;
+            }
+
+            /** Sets the limit, which applies when the terminals add history rows next time. 
+             */
+            void setLimit(size_t value) {
+                limit_ = value;
+            }
+
+            /** Returns the number of bytes occupied by the terminals using the budget as they last reported. 
+             */
+            size_t used() const {
+                return used_;
+            }
+
+        private:
+
+            void update(size_t from, size_t to) {
+                if (to > from)
+                    used_ += to - from;
+                else
+                    used_ -= from - to;
+            }
+
+            std::atomic<size_t> limit_;
+            std::atomic<size_t> used_{0};
+
+        }; // ui::AnsiTerminal::MemoryBudget
+
+        /** Returns the memory the terminal occupies. 
+         
+            Visits all cells of the buffers to find their special objects, so it is not cheap. 
+         */
+        MemoryUsage memoryUsage();
+
+        size_t memoryLimit() const {
+            return memoryLimit_;
+        }
+
+        /** Sets the number of bytes the terminal may occupy, 0 for no limit. 
+         
+            The oldest history rows are deleted while the history, its special objects and the buffers do not fit in the limit. The limit on the number of history rows applies as well. 
+         */
+        void setMemoryLimit(size_t value) {
+            std::lock_guard<PriorityLock> g{bufferLock_};
+            memoryLimit_ = value;
+            trimHistory();
+        }
+
+        MemoryBudget * memoryBudget() const {
+            return memoryBudget_;
+        }
+
+        /** Makes the terminal use given memory budget shared with other terminals, or no budget if nullptr. 
+         */
+        void setMemoryBudget(MemoryBudget * budget);
+
     protected:
 
         void setScrollOffset(Point const & value) override {
@@ -575,7 +757,17 @@ namespace ui {
             */
         void deleteLines(int lines, int top, int bottom, Cell const & fill);
 
-        void addHistoryRow(Cell * row, int cols);
+        /** Appends copy of the row to the history, packing its cells. 
+         
+            The history is not trimmed to its maximum size so that rows can be added in bulk, trimHistory() must be called afterwards. 
+         */
+        void addHistoryRow(Cell const * row, int cols);
+
+        /** Deletes the oldest history rows over the history limit, or those which do not fit in the memory limit and the memory budget. 
+         
+            Reports the memory the terminal occupies to the budget. 
+         */
+        void trimHistory();
 
         void ptyTerminated(ExitCode exitCode) override {
             schedule([this, exitCode](){
@@ -596,7 +788,7 @@ namespace ui {
          */
         int terminalBufferTop() const {
             ASSERT(bufferLock_.locked());
-            return alternateMode_ ? 0 : static_cast<int>(historyRows_.size());            
+            return alternateMode_ ? 0 : history_.size();            
         }
 
         /** Converts the given widget coordinates to terminal buffer coordinates. 
@@ -607,13 +799,13 @@ namespace ui {
             return widgetCoordinates + scrollOffset() - Point{0, terminalBufferTop()};
         }
 
-        /** Returns the cell at given coordinates. 
+        /** Copies the cell at given coordinates. 
          
-            The coordinates are adjusted for the scroll buffer and then either a terminal buffer, or history cell is returned. In case of history cells, it is possible that no cell exists at the coordinates if the particular line was terminated before, in which case nullptr is returned. 
+            The coordinates are adjusted for the scroll buffer and then either a terminal buffer, or unpacked history cell is returned. In case of history cells, it is possible that no cell exists at the coordinates if the particular line was terminated before, in which case false is returned. 
 
-            Furthermore, if the coordinates are outside of valid range, nullptr is returned as well. 
+            Furthermore, if the coordinates are outside of valid range, false is returned as well. 
          */
-        Cell const * cellAt(Point coords);
+        bool cellAt(Point coords, Cell & result);
 
         /** Returns previous cell coordinates in contents coords. (that left of current one)
          */
@@ -623,6 +815,30 @@ namespace ui {
          */
         Point nextCell(Point coords) const;
 
+        /** Returns the cell of the character left of the cursor, or nullptr if the cursor is at the beginning of a line. 
+         */
+        Cell * previousCharacter();
+
+        /** Returns true if the character left of the cursor ends with a zero width joiner. 
+         */
+        bool followsJoiner();
+
+        /** Appends the codepoint to the grapheme cluster of the character left of the cursor. 
+         
+            If there is no such character, or the grapheme table is full, the codepoint is dropped. 
+         */
+        void appendToGrapheme(char32_t codepoint);
+
+        /** Removes the grapheme clusters no longer used by either buffer or the history from the shared grapheme table, if the table is due for collection. 
+         */
+        void collectGraphemes();
+
+        /** Returns true if the cell is a word separator. Grapheme clusters never are. 
+         */
+        static bool IsWordSeparator(Cell const & c) {
+            return ! c.isGrapheme() && HELPERS_NAMESPACE_DECL::IsWordSeparator(c.codepoint());
+        }
+
         void updateCursorPosition();
 
         enum class MouseMode {
@@ -648,7 +864,10 @@ namespace ui {
             Application
         }; // AnsiTerminal::KeypadMode
 
+        /** The current palette, which can be changed by OSC 4, and the palette OSC 104 restores. 
+         */
         Palette palette_;
+        Palette initialPalette_;
 
         CursorMode cursorMode_ = CursorMode::Normal;
         /** The default cursor as specified by the configuration. */
@@ -677,6 +896,19 @@ namespace ui {
          */
         bool allowCursorChanges_ = true;
 
+        size_t parserSliceSize_ = 16384;
+
+        size_t jumpScrollThreshold_ = 65536;
+
+        /** Minimal interval between view updates when jump scrolling. 
+         */
+        static constexpr std::chrono::milliseconds JUMP_SCROLL_FRAME{16};
+
+        /** Number of bytes received and the time of the last repaint, used to detect output floods. 
+         */
+        size_t bytesSinceFrame_ = 0;
+        std::chrono::steady_clock::time_point lastFrame_;
+
         /** Determines whether alternate mode is active or not. */
         bool alternateMode_ = false;
 
@@ -691,7 +923,21 @@ namespace ui {
         mutable PriorityLock bufferLock_;
 
         int maxHistoryRows_ = 0;
-        std::deque<std::pair<int, Cell*>> historyRows_;
+
+        TerminalHistory history_;
+
+        size_t memoryLimit_ = 0;
+        MemoryBudget * memoryBudget_ = nullptr;
+        /** Memory of the terminal as last reported to the budget. */
+        size_t budgetedBytes_ = 0;
+
+        /** Number of history rows added since the view was last scrolled to the terminal. 
+         */
+        size_t historyRowsAdded_ = 0;
+
+        /** Set when scrolling to the terminal has been scheduled, but not yet executed, so that it is scheduled only once per frame. 
+         */
+        std::atomic<bool> pendingScrollToTerminal_{false};
 
     //@}
 
@@ -699,17 +945,38 @@ namespace ui {
      */
     //@{
     protected:
-        size_t received(char * buffer, char const * bufferEnd) override;
+        /** Passes the received input to the parser. 
+         
+            Since the parser keeps the state of incomplete sequences, the whole input is always processed.
+         */
+        void received(char const * buffer, char const * bufferEnd) override;
 
-        void parseCodepoint(char32_t cp);
+        /** Schedules the repaint of the terminal and, if history rows were added while scrolled to the terminal, scrolling to the terminal again. 
+         
+            Both are scheduled at most once until they are executed. Must be called with the buffer locked. 
+         */
+        void scheduleViewUpdate();
+
+        void parseCodepoint(char32_t cp) override;
+
+        /** Parses a run of printable ASCII characters. 
+         
+            The result is identical to calling parseCodepoint() for each of the characters, but the run is written into the buffer in bulk. 
+         */
+        void parseASCII(char const * begin, char const * end) override;
+        void parseControlCharacter(char c) override;
         void parseNotification();
         void parseTab();
         void parseLF();
         void parseCR();
         void parseBackspace();
-        size_t parseEscapeSequence(char const * buffer, char const * bufferEnd);
+        void parseEscapeSequence(char intermediate, char finalByte) override;
 
-        size_t parseTppSequence(char const * buffer, char const * bufferEnd);
+        /** Parses the t++ sequence. 
+         
+            The buffer lock is released while the sequence is processed so that the UI thread is free to draw the buffer. 
+         */
+        void parseTppSequence(char const * payload, char const * payloadEnd) override;
 
         /** Called when `t++` sequence is parsed & received by the terminal. 
          
@@ -723,7 +990,7 @@ namespace ui {
          
             Special sequences, such as get/set and save/restore sequences are delegated to their own functions, others are processed directly in the method. 
          */
-        void parseCSISequence(CSISequence & seq);
+        void parseCSISequence(CSISequence & seq) override;
 
         /** Parses CSI getters and setters.
          
@@ -751,10 +1018,35 @@ namespace ui {
 
         /** Parses the operating system sequence. 
          */
-        void parseOSCSequence(OSCSequence & seq);
+        void parseOSCSequence(OSCSequence & seq) override;
+
+        /** Parses the OSC 4 palette color changes and queries, given the values of the sequence. 
+         */
+        void parseOSCPalette(std::vector<std::string_view> const & values);
+
+        /** Parses the decimal palette color index of OSC 4 and OSC 104. Returns Palette::MAX_COLORS if the index is invalid. 
+         */
+        static size_t ParsePaletteIndex(std::string_view value);
+
+        /** Parses the X11 color specification used by OSC 4, i.e. `rgb:r/g/b` with 1 to 4 hex digits per channel, or `#rrggbb`. Returns false if the specification is invalid. 
+         */
+        static bool ParseColorSpec(std::string_view spec, Color & result);
+
+        /** Starts parsing of an oversized OSC sequence. 
+         
+            Only the clipboard contents (OSC 52) are expected to be this large, their data is collected as it arrives, any other sequences are ignored. 
+         */
+        void parseOSCStreamStart(OSCSequence & seq) override;
+        void parseOSCStreamData(char const * data, char const * dataEnd) override;
+        void parseOSCStreamEnd() override;
 
         static char32_t LineDrawingChars_[15];
 
+        /** Clipboard contents collected from a streamed OSC 52 sequence. 
+         */
+        std::string streamedClipboard_;
+        bool streamingClipboard_ = false;
+
 
     //@}
 
@@ -775,11 +1067,23 @@ namespace ui {
             fill(defaultCell);
         }
 
-        void insertLine(int top, int bottom, Cell const & fill);
+        /** Inserts given number of lines at the top row, scrolling the lines between top and bottom down. 
 
-        std::pair<Cell *, int> copyRow(int row, Color defaultBg);
+            The inserted lines are filled with the given cell. 
+         */
+        void insertLines(int lines, int top, int bottom, Cell const & fill);
 
-        void deleteLine(int top, int bottom, Cell const & fill);
+        /** Returns the number of columns of given row that must be kept in the history. 
+         
+            Blank cells after the end of line are not stored. 
+         */
+        int historyRowLength(int row, Color defaultBg);
+
+        /** Deletes given number of lines at the top row, scrolling the lines between top and bottom up. 
+
+            The lines that appear at the bottom are filled with the given cell. 
+         */
+        void deleteLines(int lines, int top, int bottom, Cell const & fill);
 
         void markAsLineEnd(Point p) {
             if (p.x() >= 0)
@@ -790,6 +1094,10 @@ namespace ui {
             return GetUnusedBits(c) & END_OF_LINE;
         }
 
+        static bool IsLineEnd(PackedCell const & c) {
+            return GetUnusedBits(c) & END_OF_LINE;
+        }
+
         /** Overrides canvas cursor position to disable the check whether the cell has the cursor flag. 
          
             The cursor in terminal is only one and always valid at the coordinates specified in the buffer. 
@@ -815,7 +1123,7 @@ namespace ui {
         }
         
 
-        void resize(Size size, Cell const & fill, std::function<void(Cell*, int)> addToHistory);
+        void resize(Size size, Cell const & fill, std::function<void(Cell const *, int)> addToHistory);
 
     private:
 
@@ -836,7 +1144,7 @@ namespace ui {
 
             TODO can this be used by the terminal cursor positioning, perhaps by making sure it works on more than + 1 offsets outside the valid bounds? And also scroll region and so on...
          */
-        void adjustCursorPosition(Cell const & fill, std::function<void(Cell*, int)> addToHistory);
+        void adjustCursorPosition(Cell const & fill, std::function<void(Cell const *, int)> addToHistory);
         
         /** Returns true if the given line contains only whitespace characters from given column to its width. 
          
@@ -880,7 +1188,7 @@ namespace ui {
             canvas.fill(Rect{buffer.size()}, cell);
         }
 
-        void resize(Size size, std::function<void(Cell*, int)> addToHistory) {
+        void resize(Size size, std::function<void(Cell const *, int)> addToHistory) {
             buffer.resize(size, cell, addToHistory);
             canvas = Canvas{buffer};
             scrollStart = 0;
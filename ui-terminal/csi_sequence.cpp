@@ -14,30 +14,19 @@ namespace ui {
             return result;
         }
         // parse the first byte
-        if (IsParameterByte(*x) && *x != ';' && !IsDecimalDigit(*x))
+        if (IsParameterByte(*x) && *x != ';' && *x != ':' && !IsDecimalDigit(*x))
             result.firstByte_ = *x++;
         ASSERT(result.firstByte_ != INVALID);
         // parse arguments, if any
         while (x != end && IsParameterByte(*x)) {
-            // semicolon separates arguments, in this case an empty argument, which is initialized to default value (0)
-            if (*x == ';') {
-                ++x;
-                result.args_.push_back(std::make_pair(DEFAULT_ARG_VALUE, false));
-            // otherwise if we see digit, parse the argument given
-            } else if (IsDecimalDigit(*x)) {
-                int arg = 0;
-                do {
-                    arg = arg * 10 + DecCharToNumber(*x++);
-                } while (x != end && IsDecimalDigit(*x));
-                result.args_.push_back(std::make_pair(arg, true));
-                // if there is separator, parse it as well
-                if (x != end && *x == ';')
-                    ++x;
+            if (IsDecimalDigit(*x))
+                result.parseDigit(*x);
+            else if (*x == ';' || *x == ':')
+                result.parseSeparator(*x);
             // other than numeric values are not supported for now
-            } else {
-                ++x;
+            else
                 result.firstByte_ = INVALID;
-            }
+            ++x;
         }
         // parse intermediate bytes, if there are any, the sequence is marked as invalid because these are not supported now
 		while (x != end && IsIntermediateByte(*x)) {
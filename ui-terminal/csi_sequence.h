@@ -1,16 +1,35 @@
 #pragma once 
 
-#include <vector>
+#include <algorithm>
 #include <ostream>
 
+#include "helpers/char.h"
+
 namespace ui {
 
+    /** CSI sequence.
+     
+        The arguments are stored inline, so that parsing a sequence never allocates. Arguments separated by colon instead of semicolon are sub-parameters of the preceding argument, such as in `38:2::r:g:b` true color specification.
+     */
     class CSISequence {
+        friend class VTParser;
     public:
 
+        /** Maximum number of arguments a sequence can have, any arguments past the limit are ignored. 
+         */
+        static constexpr size_t MAX_ARGS = 32;
+
+        /** Maximum value of an argument, larger values are clamped. 
+         */
+        static constexpr int MAX_ARG_VALUE = 65535;
+
         CSISequence():
             firstByte_{0},
-            finalByte_{0} {
+            finalByte_{0},
+            numArgs_{0},
+            argOpen_{false},
+            subParameter_{false},
+            args_{} {
         }
 
         bool valid() const {
@@ -30,22 +49,29 @@ namespace ui {
         }
 
         size_t numArgs() const {
-            return args_.size();
+            return numArgs_;
         }
 
         int operator [] (size_t index) const {
-            if (index >= args_.size())
+            if (index >= numArgs_)
                 return 0; // the default value for argument if not given
-            return args_[index].first;
+            return args_[index].value;
+        }
+
+        /** Returns true if the argument at given index is a sub-parameter, i.e. it was separated from the previous argument by a colon. 
+         */
+        bool isSubParameter(size_t index) const {
+            return index < numArgs_ && args_[index].subParameter;
         }
 
         CSISequence & setDefault(size_t index, int value) {
-            while (args_.size() <= index)
-                args_.push_back(std::make_pair(0, false));
-            std::pair<int, bool> & arg = args_[index];
+            ASSERT(index < MAX_ARGS);
+            while (numArgs_ <= index)
+                args_[numArgs_++] = Arg{DEFAULT_ARG_VALUE, false, false};
+            Arg & arg = args_[index];
             // because we set default args after parsing, we only change default value if it was not supplied
-            if (!arg.second)
-               arg.first = value;
+            if (!arg.specified)
+               arg.value = value;
             return *this;
         }
 
@@ -54,11 +80,11 @@ namespace ui {
             Returns true if the replace occured, false otherwise. 
             */
         bool conditionalReplace(size_t index, int value, int newValue) {
-            if (index >= args_.size())
+            if (index >= numArgs_)
                 return false;
-            if (args_[index].first != value)
+            if (args_[index].value != value)
                 return false;
-            args_[index].first = newValue;
+            args_[index].value = newValue;
             return true;
         }
 
@@ -69,9 +95,62 @@ namespace ui {
 
     private:
 
+        struct Arg {
+            int value;
+            bool specified;
+            bool subParameter;
+        };
+
+        /** Resets the sequence so that it can be parsed again. 
+         
+            The arguments storage is left as is since only the first numArgs_ arguments are ever read.
+         */
+        void reset() {
+            firstByte_ = 0;
+            finalByte_ = 0;
+            numArgs_ = 0;
+            argOpen_ = false;
+            subParameter_ = false;
+        }
+
+        /** Adds the given digit to the current argument, starting a new argument if there is none. 
+         */
+        void parseDigit(char c) {
+            if (!argOpen_) {
+                if (!addArg(0, true))
+                    return;
+                argOpen_ = true;
+            }
+            int & arg = args_[numArgs_ - 1].value;
+            arg = std::min(arg * 10 + static_cast<int>(DecCharToNumber(c)), MAX_ARG_VALUE);
+        }
+
+        /** Parses the argument separator, either `;` or `:` for sub-parameters. 
+         
+            Separator after an argument only ends the argument, otherwise it denotes an empty argument with default value.
+         */
+        void parseSeparator(char c) {
+            if (!argOpen_)
+                addArg(DEFAULT_ARG_VALUE, false);
+            argOpen_ = false;
+            subParameter_ = (c == ':');
+        }
+
+        bool addArg(int value, bool specified) {
+            if (numArgs_ == MAX_ARGS)
+                return false;
+            args_[numArgs_++] = Arg{value, specified, subParameter_};
+            return true;
+        }
+
         char firstByte_;
         char finalByte_;
-        std::vector<std::pair<int, bool>> args_;
+        unsigned char numArgs_;
+        /** True if the last argument is being parsed, i.e. digits are added to it. */
+        bool argOpen_;
+        /** True if the next argument is a sub-parameter. */
+        bool subParameter_;
+        Arg args_[MAX_ARGS];
 
         static constexpr char INVALID = -1;
         static constexpr char INCOMPLETE = -2;
@@ -99,13 +178,11 @@ namespace ui {
                 s << "\x1b[";
                 if (seq.firstByte_ != 0) 
                     s << seq.firstByte_;
-                if (!seq.args_.empty()) {
-                    for (size_t i = 0, e = seq.args_.size(); i != e; ++i) {
-                        if (seq.args_[i].second)
-                            s << seq.args_[i].first;
-                        if (i != e - 1)
-                            s << ';';
-                    }
+                for (size_t i = 0, e = seq.numArgs_; i != e; ++i) {
+                    if (i != 0)
+                        s << (seq.args_[i].subParameter ? ':' : ';');
+                    if (seq.args_[i].specified)
+                        s << seq.args_[i].value;
                 }
                 s << seq.finalByte();
             }
@@ -1,13 +1,26 @@
 #pragma once
 
-#include <string>
+#include <string_view>
+#include <ostream>
+
+#include "helpers/char.h"
 
 namespace ui {
 
+    /** OSC sequence. 
+     
+        The values are views into the parsed payload and no copies of the payload are made, the sequence is therefore only valid while the payload exists. Handlers that need to keep any of the values must copy them. 
+     */
     class OSCSequence {
     public:
+
+        /** Maximum number of values, the last value contains the rest of the payload, including any separators. 
+         */
+        static constexpr size_t MAX_ARGS = 8;
+
         OSCSequence():
-            num_{INVALID} {
+            num_{INVALID},
+            numArgs_{0} {
         }
 
         int num() const {
@@ -15,11 +28,11 @@ namespace ui {
         }
 
         size_t numArgs() const {
-            return values_.size();
+            return numArgs_;
         }
 
-        std::string const & operator [] (size_t index) const {
-            ASSERT(index < values_.size());
+        std::string_view operator [] (size_t index) const {
+            ASSERT(index < numArgs_);
             return values_[index];
         }
 
@@ -27,31 +40,59 @@ namespace ui {
             return num_ != INVALID;
         }
 
-        bool complete() const {
-            return num_ != INCOMPLETE;
-        }
+        /** Parses the OSC sequence from its payload.
 
-        /** Parses the OSC sequence from given input. 
+            The payload is everything between the leading `ESC ]` and the terminating BEL or ST. It starts with the sequence number, optionally followed by `;` separated values.
          */
-        static OSCSequence Parse(char const * & buffer, char const * end);
+        static OSCSequence Parse(char const * payload, char const * payloadEnd) {
+            OSCSequence result;
+            char const * x = payload;
+            // parse the number
+            if (x == payloadEnd || ! IsDecimalDigit(*x))
+                return result;
+            int num = 0;
+            do {
+                // prevent overflow of absurdly long numbers, which are invalid anyways
+                if (num < 65536)
+                    num = num * 10 + DecCharToNumber(*x);
+                ++x;
+            } while (x != payloadEnd && IsDecimalDigit(*x));
+            if (x == payloadEnd) {
+                result.num_ = num;
+                return result;
+            }
+            // if the number is not followed by semicolon, the sequence is invalid
+            if (*x++ != ';')
+                return result;
+            result.num_ = num;
+            // parse the values
+            char const * valueStart = x;
+            for (; x != payloadEnd && result.numArgs_ < MAX_ARGS - 1; ++x) {
+                // TODO should we do escape for the semicolon?
+                if (*x == ';') {
+                    result.values_[result.numArgs_++] = std::string_view{valueStart, static_cast<size_t>(x - valueStart)};
+                    valueStart = x + 1;
+                }
+            }
+            result.values_[result.numArgs_++] = std::string_view{valueStart, static_cast<size_t>(payloadEnd - valueStart)};
+            return result;
+        }
 
     private:
 
         int num_;
-        std::vector<std::string> values_;
+        size_t numArgs_;
+        std::string_view values_[MAX_ARGS];
 
         static constexpr int INVALID = -1;
-        static constexpr int INCOMPLETE = -2;
 
         friend std::ostream & operator << (std::ostream & s, OSCSequence const & seq) {
             if (!seq.valid()) {
                 s << "Invalid OSC Sequence";
-            } else if (!seq.complete()) {
-                s << "Incomplete OSC Sequence";
             } else {
                 s << "\x1b]" << seq.num();
-                for (auto & arg : seq.values_)
-                    s << ';' << arg;
+                for (size_t i = 0; i < seq.numArgs_; ++i)
+                    s << ';' << seq.values_[i];
             }
             return s;
         }
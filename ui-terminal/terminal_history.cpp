@@ -0,0 +1,481 @@
+#include <algorithm>
+
+#include "helpers/compression.h"
+
+#include "terminal_history.h"
+
+namespace ui {
+
+    namespace {
+
+        /** Writes the number in at most 5 bytes, 7 bits at a time.
+         */
+        void WriteNumber(char * & into, uint32_t value) {
+            while (value >= 0x80) {
+                *into++ = static_cast<char>((value & 0x7f) | 0x80);
+                value >>= 7;
+            }
+            *into++ = static_cast<char>(value);
+        }
+
+        uint32_t ReadNumber(char const * & i) {
+            uint32_t result = 0;
+            for (unsigned shift = 0; ; shift += 7) {
+                unsigned char x = static_cast<unsigned char>(*i++);
+                result |= static_cast<uint32_t>(x & 0x7f) << shift;
+                if ((x & 0x80) == 0)
+                    return result;
+            }
+        }
+
+        /** Sorts the id and count pairs and merges the counts of the same ids, returns the number of merged pairs at the beginning of the vector.
+         */
+        size_t MergeReferences(std::vector<std::pair<uint32_t, uint32_t>> & refs) {
+            std::sort(refs.begin(), refs.end());
+            size_t n = 0;
+            for (auto const & r : refs) {
+                if (n > 0 && refs[n - 1].first == r.first)
+                    refs[n - 1].second += r.second;
+                else
+                    refs[n++] = r;
+            }
+            return n;
+        }
+
+    } // anonymous namespace
+
+    /** The rows of the pages and hot lines are counted from the first row, whose line may have some of its cells trimmed already.
+     */
+    void TerminalHistory::setWidth(int width) {
+        if (width == width_)
+            return;
+        width_ = width;
+        size_t row = 0;
+        for (size_t i = 0, e = pages_.size(); i != e; ++i) {
+            Page & p = pages_[i];
+            p.row = row;
+            char const * lengths = p.lengths.data();
+            for (int line = 0; line < PAGE_LINES; ++line) {
+                int cols = static_cast<int>(ReadNumber(lengths));
+                if (i == 0 && line < trimmedLines_)
+                    continue;
+                if (i == 0 && line == trimmedLines_)
+                    cols -= firstLineTrimmed_;
+                row += rows(cols);
+            }
+        }
+        hotRow_ = row;
+        for (auto const & l : hotLines_)
+            row += rows(l.first);
+        firstRow_ = 0;
+        endRow_ = row;
+    }
+
+    /** The open line is always the most recent run in the arena, so that the cells joined to it extend the run.
+     */
+    void TerminalHistory::append(Cell const * cells, int cols, bool lineEnd) {
+        if (openLine_) {
+            auto & l = hotLines_.back();
+            endRow_ -= rows(l.first);
+            l.second = arena_.extend(l.second, static_cast<size_t>(l.first), static_cast<size_t>(cols));
+            styles_.pack(cells, cols, l.second + l.first);
+            addGraphemes(l.second + l.first, cols);
+            l.first += cols;
+            endRow_ += rows(l.first);
+        } else {
+            PackedCell * packed = arena_.allocate(static_cast<size_t>(cols));
+            styles_.pack(cells, cols, packed);
+            addGraphemes(packed, cols);
+            hotLines_.push_back(std::make_pair(cols, packed));
+            endRow_ += rows(cols);
+        }
+        hotCells_ += static_cast<size_t>(cols);
+        openLine_ = ! lineEnd;
+    }
+
+    void TerminalHistory::trim(int maxRows, size_t maxBytes) {
+        size_t max = static_cast<size_t>(std::max(maxRows, 0));
+        while (static_cast<size_t>(size()) > max)
+            dropOldest(static_cast<size_t>(size()) - max);
+        while (hotLines_.size() >= static_cast<size_t>(HOT_LINES + PAGE_LINES))
+            compressPage();
+        spill();
+        // only dropping a whole page frees its memory
+        while (size() > 0 && bytes() + styles_.specialObjectBytes() > maxBytes) {
+            size_t pages = pages_.size();
+            do {
+                dropLine();
+            } while (pages != 0 && pages_.size() == pages);
+        }
+        // with no rows left, the buffers of the compression are the last memory that can be released
+        if (size() == 0 && bytes() + styles_.specialObjectBytes() > maxBytes) {
+            std::vector<std::pair<int, PackedCell const *>>{}.swap(lines_);
+            std::vector<std::pair<uint32_t, uint32_t>>{}.swap(runs_);
+            std::vector<std::pair<uint32_t, uint32_t>>{}.swap(graphemes_);
+            std::vector<uint32_t>{}.swap(graphemeRefs_);
+            std::vector<char>{}.swap(raw_);
+            std::string{}.swap(compressed_);
+        }
+    }
+
+    size_t TerminalHistory::bytes() const {
+        size_t result = hotCells_ * sizeof(PackedCell) + hotLines_.size() * sizeof(std::pair<int, PackedCell *>);
+        result += memoryBytes_ + pages_.size() * sizeof(Page) + pageIndexBytes_;
+        for (DecodedPage const & d : decoded_)
+            result += d.cells.capacity() * sizeof(PackedCell) + d.offsets.capacity() * sizeof(int);
+        result += graphemeRefs_.capacity() * sizeof(uint32_t);
+        result += lines_.capacity() * sizeof(std::pair<int, PackedCell const *>) + (runs_.capacity() + graphemes_.capacity()) * sizeof(std::pair<uint32_t, uint32_t>) + raw_.capacity() + compressed_.capacity();
+        return result + styles_.bytes();
+    }
+
+    /** The trimmed cells of a hot line are freed immediately, so that a line which never ends does not grow indefinitely, while a cold line only remembers how many of its cells have been trimmed.
+     */
+    void TerminalHistory::dropOldest(size_t rows) {
+        int cols = firstLineLength() - firstLineTrimmed_;
+        if (rows >= this->rows(cols)) {
+            dropLine();
+            return;
+        }
+        int trimmed = static_cast<int>(rows) * width_;
+        firstRow_ += rows;
+        if (! pages_.empty()) {
+            firstLineTrimmed_ += trimmed;
+        } else {
+            auto & l = hotLines_.front();
+            styles_.release(l.second, trimmed);
+            releaseGraphemes(l.second, trimmed);
+            arena_.free(l.second, static_cast<size_t>(trimmed));
+            hotCells_ -= static_cast<size_t>(trimmed);
+            l.second += trimmed;
+            l.first -= trimmed;
+            hotRow_ = firstRow_;
+        }
+    }
+
+    /** The cells of a hot line are freed at once, while the cells of a cold line are freed with its page.
+     */
+    void TerminalHistory::dropLine() {
+        firstRow_ += rows(firstLineLength() - firstLineTrimmed_);
+        firstLineTrimmed_ = 0;
+        if (! pages_.empty()) {
+            char const * lengths = pages_.front().lengths.data() + trimmedLengths_;
+            ReadNumber(lengths);
+            trimmedLengths_ = static_cast<size_t>(lengths - pages_.front().lengths.data());
+            if (++trimmedLines_ == PAGE_LINES)
+                dropPage();
+        } else {
+            auto const & l = hotLines_.front();
+            styles_.release(l.second, l.first);
+            releaseGraphemes(l.second, l.first);
+            arena_.free(l.second, static_cast<size_t>(l.first));
+            hotCells_ -= static_cast<size_t>(l.first);
+            hotLines_.pop_front();
+            hotRow_ = firstRow_;
+            if (hotLines_.empty())
+                openLine_ = false;
+        }
+    }
+
+    void TerminalHistory::markGraphemes(std::vector<bool> & used) const {
+        if (used.size() < graphemeRefs_.size())
+            used.resize(graphemeRefs_.size());
+        for (size_t id = 0, e = graphemeRefs_.size(); id != e; ++id)
+            if (graphemeRefs_[id] != 0)
+                used[id] = true;
+    }
+
+    void TerminalHistory::addGraphemes(PackedCell const * cells, int cols) {
+        for (PackedCell const * c = cells, * e = cells + cols; c != e; ++c) {
+            if (! c->isGrapheme())
+                continue;
+            if (c->graphemeId() >= graphemeRefs_.size())
+                graphemeRefs_.resize(c->graphemeId() + 1);
+            ++graphemeRefs_[c->graphemeId()];
+        }
+    }
+
+    void TerminalHistory::releaseGraphemes(PackedCell const * cells, int cols) {
+        for (PackedCell const * c = cells, * e = cells + cols; c != e; ++c) {
+            if (! c->isGrapheme())
+                continue;
+            ASSERT(c->graphemeId() < graphemeRefs_.size() && graphemeRefs_[c->graphemeId()] > 0);
+            --graphemeRefs_[c->graphemeId()];
+        }
+    }
+
+    int TerminalHistory::firstLineLength() {
+        ASSERT(size() > 0);
+        if (pages_.empty())
+            return hotLines_.front().first;
+        char const * lengths = pages_.front().lengths.data() + trimmedLengths_;
+        return static_cast<int>(ReadNumber(lengths));
+    }
+
+    /** Pages already in a previous file are loaded back to memory first.
+     */
+    void TerminalHistory::setFile(std::string const & filename, size_t memoryLimit) {
+        for (size_t i = 0; i < filePages_; ++i) {
+            Page & p = pages_[i];
+            p.data.assign(file_->data() + p.offset, p.fileSize);
+            p.offset = NONE;
+            p.fileSize = 0;
+            memoryBytes_ += p.data.size();
+        }
+        filePages_ = 0;
+        fileLiveBytes_ = 0;
+        file_.reset();
+        memoryLimit_ = memoryLimit;
+        if (! filename.empty())
+            file_.reset(new MappedFile{filename});
+        spill();
+    }
+
+    /** A cold row is found in the page whose first row is the closest before it by a binary search and then by counting the rows of the page's lines from the page's first row. A hot row is found by counting the rows of the hot lines from the last one, as the most recent rows are accessed the most.
+     */
+    std::pair<int, TerminalHistory::PackedCell *> TerminalHistory::mutableRow(int index, bool modify) {
+        ASSERT(index >= 0 && index < size());
+        size_t row = firstRow_ + static_cast<size_t>(index);
+        if (row >= hotRow_) {
+            size_t lineStart = endRow_;
+            for (auto i = hotLines_.rbegin(), e = hotLines_.rend(); i != e; ++i) {
+                lineStart -= rows(i->first);
+                if (row >= lineStart)
+                    return lineRow(row, i->second, i->first, lineStart, 0);
+            }
+            UNREACHABLE;
+        }
+        auto p = std::upper_bound(pages_.begin() + 1, pages_.end(), row, [](size_t row, Page const & p) {
+            return row < p.row;
+        }) - 1;
+        size_t page = static_cast<size_t>(p - pages_.begin());
+        DecodedPage & d = decode(firstPage_ + page);
+        d.dirty = d.dirty || modify;
+        int line = page == 0 ? trimmedLines_ : 0;
+        size_t lineStart = page == 0 ? firstRow_ : p->row;
+        while (true) {
+            ASSERT(line < PAGE_LINES);
+            bool first = page == 0 && line == trimmedLines_;
+            int start = d.offsets[line] + (first ? firstLineTrimmed_ : 0);
+            int cols = d.offsets[line + 1] - start;
+            if (row < lineStart + rows(cols))
+                return lineRow(row, d.cells.data() + d.offsets[line], d.offsets[line + 1] - d.offsets[line], lineStart, first ? firstLineTrimmed_ : 0);
+            lineStart += rows(cols);
+            ++line;
+        }
+    }
+
+    std::pair<int, TerminalHistory::PackedCell *> TerminalHistory::lineRow(size_t row, PackedCell * cells, int cols, size_t lineRow, int trimmed) const {
+        int start = trimmed;
+        if (width_ > 0)
+            start += static_cast<int>(row - lineRow) * width_;
+        int rowCols = width_ > 0 ? std::min(width_, cols - start) : cols - start;
+        return std::make_pair(rowCols, cells + start);
+    }
+
+    void TerminalHistory::compressPage() {
+        ASSERT(hotLines_.size() >= static_cast<size_t>(PAGE_LINES));
+        lines_.assign(hotLines_.begin(), hotLines_.begin() + PAGE_LINES);
+        pages_.emplace_back();
+        pages_.back().row = hotRow_;
+        encode(pages_.back());
+        memoryBytes_ += pages_.back().data.size();
+        // the page keeps the style and grapheme references
+        for (auto const & l : lines_) {
+            arena_.free(l.second, static_cast<size_t>(l.first));
+            hotCells_ -= static_cast<size_t>(l.first);
+            hotRow_ += rows(l.first);
+        }
+        hotLines_.erase(hotLines_.begin(), hotLines_.begin() + PAGE_LINES);
+    }
+
+    void TerminalHistory::encode(Page & into) {
+        size_t cells = 0;
+        for (auto const & l : lines_)
+            cells += static_cast<size_t>(l.first);
+        // the codepoint of each cell and at worst a style run per cell, the buffer is never empty so that a page of empty lines has valid data
+        size_t maxSize = cells * 15 + 1;
+        if (raw_.size() < maxSize)
+            raw_.resize(maxSize);
+        char lengths[PAGE_LINES * 5];
+        char * out = lengths;
+        for (auto const & l : lines_)
+            WriteNumber(out, static_cast<uint32_t>(l.first));
+        pageIndexBytes_ -= into.lengths.capacity();
+        into.lengths.assign(lengths, out);
+        pageIndexBytes_ += into.lengths.capacity();
+        out = raw_.data();
+        // style runs continue across lines
+        runs_.clear();
+        graphemes_.clear();
+        uint32_t style = 0;
+        uint32_t run = 0;
+        for (auto const & l : lines_) {
+            for (PackedCell const * c = l.second, * e = l.second + l.first; c != e; ++c) {
+                WriteNumber(out, c->rawCodepoint());
+                if (c->isGrapheme())
+                    graphemes_.push_back(std::make_pair(c->graphemeId(), 1));
+                uint32_t s = c->style();
+                if (s != style) {
+                    if (run != 0)
+                        runs_.push_back(std::make_pair(style, run));
+                    style = s;
+                    run = 0;
+                }
+                ++run;
+            }
+        }
+        if (run != 0)
+            runs_.push_back(std::make_pair(style, run));
+        for (auto const & r : runs_) {
+            WriteNumber(out, r.first);
+            WriteNumber(out, r.second);
+        }
+        into.size = static_cast<size_t>(out - raw_.data());
+        // merge the references of the same styles and grapheme clusters
+        size_t n = MergeReferences(runs_);
+        pageIndexBytes_ -= into.styles.capacity() * sizeof(std::pair<uint32_t, uint32_t>);
+        into.styles.assign(runs_.begin(), runs_.begin() + n);
+        pageIndexBytes_ += into.styles.capacity() * sizeof(std::pair<uint32_t, uint32_t>);
+        n = MergeReferences(graphemes_);
+        pageIndexBytes_ -= into.graphemes.capacity() * sizeof(std::pair<uint32_t, uint32_t>);
+        into.graphemes.assign(graphemes_.begin(), graphemes_.begin() + n);
+        pageIndexBytes_ += into.graphemes.capacity() * sizeof(std::pair<uint32_t, uint32_t>);
+        // the page's data is copied from the scratch buffer so that it is allocated only once and of the exact size
+        compressed_.clear();
+        LZCompress(raw_.data(), into.size, compressed_);
+        into.data.assign(compressed_);
+    }
+
+    TerminalHistory::DecodedPage & TerminalHistory::decode(size_t page) {
+        for (size_t i = 0; i < 2; ++i) {
+            if (decoded_[i].page == page) {
+                lruDecoded_ = 1 - i;
+                return decoded_[i];
+            }
+        }
+        DecodedPage & d = decoded_[lruDecoded_];
+        lruDecoded_ = 1 - lruDecoded_;
+        flush(d);
+        ASSERT(page >= firstPage_ && page - firstPage_ < pages_.size());
+        Page const & p = pages_[page - firstPage_];
+        if (raw_.size() < p.size)
+            raw_.resize(p.size);
+        if (p.offset == NONE)
+            LZDecompress(p.data.data(), p.data.size(), raw_.data(), p.size);
+        else
+            LZDecompress(file_->data() + p.offset, p.fileSize, raw_.data(), p.size);
+        char const * i = raw_.data();
+        d.page = page;
+        d.dirty = false;
+        d.offsets.resize(PAGE_LINES + 1);
+        d.offsets[0] = 0;
+        char const * lengths = p.lengths.data();
+        for (int line = 0; line < PAGE_LINES; ++line)
+            d.offsets[line + 1] = d.offsets[line] + static_cast<int>(ReadNumber(lengths));
+        size_t cells = static_cast<size_t>(d.offsets[PAGE_LINES]);
+        d.cells.resize(cells);
+        for (size_t c = 0; c < cells; ++c)
+            d.cells[c] = PackedCell::FromRaw(ReadNumber(i), 0);
+        for (size_t c = 0; c < cells; ) {
+            uint32_t style = ReadNumber(i);
+            for (uint32_t run = ReadNumber(i); run > 0; --run, ++c)
+                d.cells[c] = PackedCell::FromRaw(d.cells[c].rawCodepoint(), style);
+        }
+        ASSERT(i == raw_.data() + p.size);
+        return d;
+    }
+
+    void TerminalHistory::flush(DecodedPage & decoded) {
+        if (decoded.page == NONE || ! decoded.dirty)
+            return;
+        lines_.clear();
+        for (int line = 0; line < PAGE_LINES; ++line)
+            lines_.push_back(std::make_pair(decoded.offsets[line + 1] - decoded.offsets[line], decoded.cells.data() + decoded.offsets[line]));
+        Page & p = pages_[decoded.page - firstPage_];
+        memoryBytes_ -= p.data.size();
+        encode(p);
+        // a page from the file is appended to it again, its old data become garbage
+        if (p.offset != NONE) {
+            fileLiveBytes_ -= p.fileSize;
+            movePageToFile(p);
+        } else {
+            memoryBytes_ += p.data.size();
+        }
+        decoded.dirty = false;
+    }
+
+    /** If the page has been modified, the style references held by its decoded cells are released instead of those counted by the page. The grapheme clusters of the cells never change, so that the counts of the page are always up to date.
+     */
+    void TerminalHistory::dropPage() {
+        ASSERT(! pages_.empty());
+        bool released = false;
+        for (DecodedPage & d : decoded_) {
+            if (d.page != firstPage_)
+                continue;
+            if (d.dirty) {
+                styles_.release(d.cells.data(), static_cast<int>(d.cells.size()));
+                released = true;
+            }
+            d = DecodedPage{};
+        }
+        Page & p = pages_.front();
+        if (! released)
+            for (auto const & s : p.styles)
+                styles_.release(s.first, s.second);
+        for (auto const & g : p.graphemes) {
+            ASSERT(graphemeRefs_[g.first] >= g.second);
+            graphemeRefs_[g.first] -= g.second;
+        }
+        pageIndexBytes_ -= (p.styles.capacity() + p.graphemes.capacity()) * sizeof(std::pair<uint32_t, uint32_t>) + p.lengths.capacity();
+        if (p.offset == NONE) {
+            memoryBytes_ -= p.data.size();
+        } else {
+            --filePages_;
+            fileLiveBytes_ -= p.fileSize;
+        }
+        pages_.pop_front();
+        ++firstPage_;
+        trimmedLines_ = 0;
+        trimmedLengths_ = 0;
+        if (filePages_ == 0 && file_ != nullptr && file_->size() != 0)
+            file_->clear();
+        else if (file_ != nullptr && file_->size() > std::max(fileLiveBytes_ * 2, MappedFile::MIN_CAPACITY))
+            compactFile();
+    }
+
+    void TerminalHistory::spill() {
+        if (file_ == nullptr)
+            return;
+        while (memoryBytes_ > memoryLimit_ && filePages_ < pages_.size()) {
+            Page & p = pages_[filePages_++];
+            memoryBytes_ -= p.data.size();
+            movePageToFile(p);
+        }
+    }
+
+    void TerminalHistory::movePageToFile(Page & page) {
+        page.offset = file_->append(page.data.data(), page.data.size());
+        page.fileSize = page.data.size();
+        fileLiveBytes_ += page.fileSize;
+        std::string{}.swap(page.data);
+    }
+
+    /** The pages are moved towards the start of the file in the order of their offsets, so that no page overwrites data of another one which has not been moved yet.
+     */
+    void TerminalHistory::compactFile() {
+        std::vector<Page *> pages;
+        for (size_t i = 0; i < filePages_; ++i)
+            pages.push_back(& pages_[i]);
+        std::sort(pages.begin(), pages.end(), [](Page const * a, Page const * b) {
+            return a->offset < b->offset;
+        });
+        size_t size = 0;
+        for (Page * p : pages) {
+            memmove(file_->data() + size, file_->data() + p->offset, p->fileSize);
+            p->offset = size;
+            size += p->fileSize;
+        }
+        file_->resize(size);
+    }
+
+} // namespace ui
@@ -0,0 +1,292 @@
+#pragma once
+
+#include <deque>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "helpers/arena.h"
+#include "helpers/mapped_file.h"
+
+#include "ui/canvas.h"
+
+namespace ui {
+
+    /** Scrollback history of a terminal.
+
+        The history stores logical lines, i.e. the rows of a line wrapped by the terminal are joined, as packed cells whose styles are interned in the history's style table. The lines are displayed as rows of the history's width, which is a view computed on demand: each page remembers the row at which it starts for the current width, so that changing the width only recounts the rows of every line from its length, without touching the cells. A row is located by a binary search for its page and by wrapping the lines of that page alone, or by wrapping the few hot lines.
+
+        The most recent lines, at least HOT_LINES of them, are kept as they are in an arena, the last of them growing while the rows appended to it are not terminated. Older lines are grouped in pages of PAGE_LINES lines, which are compressed as they are rarely ever accessed again.
+
+        A page keeps the lengths of its lines uncompressed, as variable length numbers, so that its rows can be counted. Its cells are serialized as their raw codepoints, again as variable length numbers, followed by the run length encoded style ids, and compressed by LZCompress(). The style references of the cells are kept by the page, which also remembers how many references to each style it holds so that it can release them without being decompressed. The references to grapheme clusters are counted the same way, so that the history can tell which clusters its rows still use without decompressing them, see markGraphemes().
+
+        Cold lines are decompressed on demand, a page at a time, when their rows are painted, selected, or otherwise accessed. The last two decompressed pages are cached and if their lines are modified, the page is compressed again when it is evicted from the cache.
+
+        When the history is given a file, the oldest compressed pages which do not fit in the memory limit are moved to the file, which is memory mapped. Pages only remember their offsets in the file and are decompressed from there. A modified page is appended to the file again and the space the pages trimmed from the history occupied is reclaimed once it is larger than the rest of the file.
+
+        The history is not thread safe.
+     */
+    class TerminalHistory {
+    public:
+        using Cell = Canvas::Cell;
+        using PackedCell = Canvas::PackedCell;
+
+        /** Number of lines in a compressed page.
+         */
+        static constexpr int PAGE_LINES = 128;
+
+        /** Number of the most recent lines which are never compressed.
+         */
+        static constexpr int HOT_LINES = 64;
+
+        TerminalHistory() = default;
+
+        TerminalHistory(TerminalHistory const &) = delete;
+        TerminalHistory & operator = (TerminalHistory const &) = delete;
+
+        /** Returns the number of rows of the history at its current width.
+         */
+        int size() const {
+            return static_cast<int>(endRow_ - firstRow_);
+        }
+
+        /** Returns the absolute number of the first row.
+
+            Rows keep their absolute numbers while older rows are trimmed, so that the numbers identify the rows until the width changes and the rows are numbered from zero again.
+         */
+        size_t firstRow() const {
+            return firstRow_;
+        }
+
+        int width() const {
+            return width_;
+        }
+
+        /** Changes the width of the rows.
+
+            Only the numbers of rows of the lines are recounted from their lengths, the cells are wrapped to the new width when their rows are accessed.
+         */
+        void setWidth(int width);
+
+        Canvas::StyleTable & styles() {
+            return styles_;
+        }
+
+        /** Returns the number of columns and the packed cells of given row.
+
+            The cells are only valid until the history is modified, as the last line may move when it grows. The cells of a cold row belong to its decompressed page and are also invalidated when rows from other pages are accessed.
+         */
+        std::pair<int, PackedCell const *> row(int index) {
+            return mutableRow(index, false);
+        }
+
+        /** Returns the row whose cells are going to be modified.
+
+            Any style references the modified cells gain or lose must be accounted for in the style table. The grapheme clusters of the cells must not change.
+         */
+        std::pair<int, PackedCell *> mutableRow(int index) {
+            return mutableRow(index, true);
+        }
+
+        /** Unpacks the cells of given row.
+         */
+        void unpack(int index, std::vector<Cell> & into) {
+            auto r = row(index);
+            into.resize(r.first);
+            styles_.unpack(r.second, r.first, into.data());
+        }
+
+        /** Appends copy of the row's cells to the history, packing them.
+
+            If the last line has not been terminated yet, the cells are joined to it. Unless terminated by the row, the line continues with the next row appended.
+         */
+        void append(Cell const * cells, int cols, bool lineEnd);
+
+        /** Deletes the oldest rows over given limit and compresses the pages that are no longer hot.
+
+            The rows of the oldest line are deleted one by one, although the memory of a cold line is only freed with its page. Then deletes the oldest lines while the history occupies more than given number of bytes, including the special objects its styles refer to. As only whole pages free their memory, the rest of the oldest page is deleted at once.
+         */
+        void trim(int maxRows, size_t maxBytes = std::numeric_limits<size_t>::max());
+
+        /** Marks the ids of the grapheme clusters the rows of the history refer to, growing the vector as needed.
+         */
+        void markGraphemes(std::vector<bool> & used) const;
+
+        /** Returns the number of bytes the history occupies in memory.
+
+            Includes the packed hot rows, the compressed pages in memory, the decompressed pages, the scratch buffers and the style table, but not the special objects the styles refer to, see Canvas::StyleTable::specialObjectBytes().
+         */
+        size_t bytes() const;
+
+        /** Moves the compressed pages over given memory limit in bytes to the file, which is created immediately.
+
+            Throws OSError if the file can't be created.
+         */
+        void setFile(std::string const & filename, size_t memoryLimit);
+
+        /** Returns the number of bytes the compressed pages occupy in memory.
+         */
+        size_t memoryBytes() const {
+            return memoryBytes_;
+        }
+
+        /** Returns the number of bytes the history occupies in its file, 0 if it has none.
+         */
+        size_t fileBytes() const {
+            return file_ == nullptr ? 0 : file_->size();
+        }
+
+    private:
+
+        struct Page {
+            /** The compressed page, empty if the page is in the file. */
+            std::string data;
+            /** Size of the serialized page before compression. */
+            size_t size;
+            /** Lengths of the page's lines as variable length numbers. */
+            std::string lengths;
+            /** Absolute number of the row at which the page's first line starts. */
+            size_t row;
+            /** Offset and size of the compressed page in the file, if it has been moved there. */
+            size_t offset = NONE;
+            size_t fileSize = 0;
+            /** Ids of the styles the page's cells refer to and the number of their references. */
+            std::vector<std::pair<uint32_t, uint32_t>> styles;
+            /** Ids of the grapheme clusters the page's cells refer to and the number of their references. */
+            std::vector<std::pair<uint32_t, uint32_t>> graphemes;
+        };
+
+        struct DecodedPage {
+            /** Absolute number of the page, or NONE if the slot is empty. */
+            size_t page = NONE;
+            bool dirty = false;
+            /** Offsets of the lines in the cells, followed by the number of cells. */
+            std::vector<int> offsets;
+            std::vector<PackedCell> cells;
+        };
+
+        static constexpr size_t NONE = static_cast<size_t>(-1);
+
+        /** Returns the number of rows of a line of given length.
+         */
+        size_t rows(int cols) const {
+            if (cols == 0 || width_ <= 0)
+                return 1;
+            return static_cast<size_t>((cols + width_ - 1) / width_);
+        }
+
+        std::pair<int, PackedCell *> mutableRow(int index, bool modify);
+
+        /** Returns the row of given absolute number from the line of given cells whose rows start at given row after given number of trimmed cells.
+         */
+        std::pair<int, PackedCell *> lineRow(size_t row, PackedCell * cells, int cols, size_t lineRow, int trimmed) const;
+
+        /** Returns the length of the oldest line.
+         */
+        int firstLineLength();
+
+        /** Adds or releases the references of the cells to their grapheme clusters.
+         */
+        void addGraphemes(PackedCell const * cells, int cols);
+        void releaseGraphemes(PackedCell const * cells, int cols);
+
+        /** Compresses the oldest PAGE_LINES hot lines into a new page.
+         */
+        void compressPage();
+
+        /** Serializes and compresses the lines in lines_ into the page.
+         */
+        void encode(Page & into);
+
+        /** Returns the decompressed page of given absolute number, decompressing it if it is not cached.
+         */
+        DecodedPage & decode(size_t page);
+
+        /** Compresses the decoded page again if its rows have been modified.
+         */
+        void flush(DecodedPage & decoded);
+
+        /** Deletes at most given number of the oldest rows, never more than the rest of the oldest line.
+         */
+        void dropOldest(size_t rows);
+
+        /** Deletes the rest of the oldest line.
+         */
+        void dropLine();
+
+        /** Removes the oldest page, releasing its style references.
+         */
+        void dropPage();
+
+        /** Moves the oldest pages in memory to the file while they are over the memory limit.
+         */
+        void spill();
+
+        /** Moves the page to the end of the file.
+         */
+        void movePageToFile(Page & page);
+
+        /** Removes the garbage left in the file by pages that were trimmed or appended again.
+         */
+        void compactFile();
+
+        Canvas::StyleTable styles_;
+
+        int width_ = 0;
+        /** Absolute numbers of the first row and of the row after the last one. The rows are numbered from the first row at the time the width changed last. */
+        size_t firstRow_ = 0;
+        size_t endRow_ = 0;
+
+        /** Uncompressed lines, allocated in the arena oldest first.
+         */
+        FifoArena<PackedCell> arena_;
+        std::deque<std::pair<int, PackedCell *>> hotLines_;
+        size_t hotCells_ = 0;
+        /** Absolute number of the first row of the hot lines. */
+        size_t hotRow_ = 0;
+        /** True if the last hot line continues with the next row appended. */
+        bool openLine_ = false;
+
+        /** Compressed pages, the first of which may have some of its lines already trimmed.
+         */
+        std::deque<Page> pages_;
+        /** Bytes of the style and grapheme counts and line lengths of all pages. */
+        size_t pageIndexBytes_ = 0;
+        int trimmedLines_ = 0;
+        /** Number of bytes of the first page's line lengths that belong to the trimmed lines. */
+        size_t trimmedLengths_ = 0;
+        /** Number of cells at the start of the oldest line whose rows have been trimmed, if the line is cold. */
+        int firstLineTrimmed_ = 0;
+        /** Absolute number of the first page, which is the number of pages dropped so far.
+         */
+        size_t firstPage_ = 0;
+
+        /** The file and the limit of the compressed pages in memory. Pages moved to the file are always the oldest ones.
+         */
+        std::unique_ptr<MappedFile> file_;
+        size_t memoryLimit_ = 0;
+        size_t memoryBytes_ = 0;
+        size_t filePages_ = 0;
+        /** Number of bytes in the file which belong to pages still in the history. */
+        size_t fileLiveBytes_ = 0;
+
+        /** Number of references to each grapheme cluster from the rows of the history, by the cluster's id. */
+        std::vector<uint32_t> graphemeRefs_;
+
+        DecodedPage decoded_[2];
+        /** Index of the least recently used decoded page.
+         */
+        size_t lruDecoded_ = 0;
+
+        /** Scratch buffers of the encoding and decoding, kept so that compressing a page does not allocate.
+         */
+        std::vector<std::pair<int, PackedCell const *>> lines_;
+        std::vector<std::pair<uint32_t, uint32_t>> runs_;
+        std::vector<std::pair<uint32_t, uint32_t>> graphemes_;
+        std::vector<char> raw_;
+        std::string compressed_;
+
+    }; // ui::TerminalHistory
+
+} // namespace ui
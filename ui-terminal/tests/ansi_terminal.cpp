@@ -0,0 +1,59 @@
+#include <condition_variable>
+#include <mutex>
+
+#include "helpers/tests.h"
+
+#include "tpp-lib/pty_recording.h"
+
+#include "../ansi_terminal.h"
+
+using namespace ui;
+
+namespace {
+
+    /** Terminal of given size which parses the recorded output and allows its buffer to be checked once all of the output has been parsed.
+     */
+    class ReplayTerminal : public AnsiTerminal {
+    public:
+        ReplayTerminal(tpp::PTYRecording const & recording, Size const & size):
+            ReplayTerminal{new tpp::ReplayPTYMaster{recording, false}, size} {
+        }
+
+        Cell const & at(int col, int row) const {
+            return state_->buffer.at(Point{col, row});
+        }
+
+    protected:
+        void ptyTerminated(ExitCode exitCode) override {
+            MARK_AS_UNUSED(exitCode);
+            {
+                std::lock_guard<std::mutex> g{m_};
+                done_ = true;
+            }
+            cv_.notify_all();
+        }
+
+    private:
+        ReplayTerminal(tpp::ReplayPTYMaster * pty, Size const & size):
+            AnsiTerminal{pty, Palette::XTerm256()} {
+            resize(size);
+            pty->start();
+            std::unique_lock<std::mutex> g{m_};
+            cv_.wait(g, [this](){ return done_; });
+        }
+
+        bool done_ = false;
+        std::mutex m_;
+        std::condition_variable cv_;
+    };
+
+}
+
+TEST(ui_terminal, doubleWidthCharacterInSingleColumn) {
+    // U+4E2D is double width
+    tpp::PTYRecording recording{tpp::PTYRecording::FromOutput("\xe4\xb8\xad" "x")};
+    ReplayTerminal terminal{recording, Size{1, 3}};
+    EXPECT(terminal.at(0, 0).codepoint() == 0x4e2d);
+    EXPECT(! terminal.at(0, 0).font().doubleWidth());
+    EXPECT(terminal.at(0, 1).codepoint() == 'x');
+}
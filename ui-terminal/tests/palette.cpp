@@ -0,0 +1,24 @@
+#include "helpers/tests.h"
+
+#include "../ansi_terminal.h"
+
+using namespace ui;
+
+TEST(ui_terminal_palette, indexedColors) {
+    AnsiTerminal::Palette palette(16, Color::White, Color::Black);
+    palette.setColor(1, Color::DarkRed);
+    Color red = AnsiTerminal::Palette::Indexed(1);
+    Color fg = AnsiTerminal::Palette::Indexed(AnsiTerminal::Palette::DEFAULT_FG);
+    EXPECT(AnsiTerminal::Palette::IsIndexed(red));
+    EXPECT(palette.resolve(red) == Color::DarkRed);
+    EXPECT(palette.resolve(fg) == Color::White);
+    // changes of the palette apply to the colors referring to it
+    palette.setColor(1, Color::Red);
+    palette.setDefaultForeground(Color::Gray);
+    EXPECT(palette.resolve(red) == Color::Red);
+    EXPECT(palette.resolve(fg) == Color::Gray);
+    // direct colors are not affected
+    EXPECT(! AnsiTerminal::Palette::IsIndexed(Color::Red));
+    EXPECT(palette.resolve(Color{1, 2, 3}) == (Color{1, 2, 3}));
+    EXPECT(! AnsiTerminal::Palette::IsIndexed(Color::None));
+}
@@ -0,0 +1,248 @@
+#include "helpers/tests.h"
+
+#include "helpers/filesystem.h"
+
+#include "../terminal_history.h"
+
+using namespace ui;
+
+namespace {
+
+    /** The lines expected in the history, the first of which may have some of its rows trimmed already.
+     */
+    class HistoryModel {
+    public:
+        explicit HistoryModel(int width):
+            width_{width} {
+        }
+
+        void setWidth(int width) {
+            width_ = width;
+        }
+
+        /** Appends the line to the history and to the model, the line continues with the next one unless terminated.
+         */
+        void append(TerminalHistory & history, std::u32string const & text, bool lineEnd = true) {
+            std::vector<Canvas::Cell> cells(text.size());
+            for (size_t i = 0; i < text.size(); ++i) {
+                cells[i].setCodepoint(text[i]);
+                // a few different styles so that the pages have style runs
+                if (text[i] % 3 == 0)
+                    cells[i].setFg(Color::Red);
+            }
+            history.append(cells.data(), static_cast<int>(cells.size()), lineEnd);
+            if (open_)
+                lines_.back() += text;
+            else
+                lines_.push_back(text);
+            open_ = ! lineEnd;
+        }
+
+        /** Deletes given number of the oldest rows.
+         */
+        void trim(size_t rows) {
+            while (rows > 0) {
+                size_t first = this->rows(lines_.front());
+                if (rows >= first) {
+                    lines_.pop_front();
+                    rows -= first;
+                } else {
+                    lines_.front().erase(0, rows * static_cast<size_t>(width_));
+                    rows = 0;
+                }
+            }
+            if (lines_.empty())
+                open_ = false;
+        }
+
+        std::vector<std::u32string> rows() const {
+            std::vector<std::u32string> result;
+            for (auto const & line : lines_) {
+                if (line.empty())
+                    result.push_back(line);
+                for (size_t i = 0; i < line.size(); i += static_cast<size_t>(width_))
+                    result.push_back(line.substr(i, static_cast<size_t>(width_)));
+            }
+            return result;
+        }
+
+        /** Returns true if the history has exactly the rows of the model.
+         */
+        bool matches(TerminalHistory & history) const {
+            std::vector<std::u32string> expected{rows()};
+            if (static_cast<size_t>(history.size()) != expected.size())
+                return false;
+            for (size_t i = 0; i < expected.size(); ++i) {
+                auto row = history.row(static_cast<int>(i));
+                std::u32string actual;
+                for (int col = 0; col < row.first; ++col)
+                    actual.push_back(row.second[col].codepoint());
+                if (actual != expected[i])
+                    return false;
+            }
+            return true;
+        }
+
+    private:
+
+        size_t rows(std::u32string const & line) const {
+            return line.empty() ? 1 : (line.size() + static_cast<size_t>(width_) - 1) / static_cast<size_t>(width_);
+        }
+
+        int width_;
+        std::deque<std::u32string> lines_;
+        bool open_ = false;
+    };
+
+    /** Returns a line of given length whose characters depend on its index, so that lines of the same length differ.
+     */
+    std::u32string Line(size_t index, size_t length) {
+        std::u32string result;
+        for (size_t i = 0; i < length; ++i)
+            result.push_back(static_cast<char32_t>('a' + (index + i) % 26));
+        return result;
+    }
+
+    /** Appends enough lines for several pages to be compressed.
+     */
+    void Fill(TerminalHistory & history, HistoryModel & model, size_t lines) {
+        for (size_t i = 0; i < lines; ++i) {
+            // every fifth line continues with the next one
+            model.append(history, Line(i, i % 37), i % 5 != 0);
+            history.trim(1000000);
+        }
+    }
+
+}
+
+TEST(ui_terminal_history, rowsOfCompressedLines) {
+    TerminalHistory history;
+    history.setWidth(10);
+    HistoryModel model{10};
+    Fill(history, model, TerminalHistory::PAGE_LINES * 4);
+    EXPECT(history.memoryBytes() > 0);
+    EXPECT(model.matches(history));
+    // modified cold rows are compressed again when their page is evicted from the cache
+    auto row = history.mutableRow(1);
+    EXPECT(row.first > 0);
+    Canvas::Cell blue;
+    blue.setCodepoint(row.second[0].codepoint()).setFg(Color::Blue);
+    Canvas::PackedCell old = row.second[0];
+    row.second[0] = history.styles().pack(blue);
+    history.styles().release(old);
+    for (int i = 0; i < history.size(); i += 10)
+        history.row(i);
+    std::vector<Canvas::Cell> cells;
+    history.unpack(1, cells);
+    EXPECT(cells[0].fg() == Color::Blue);
+    EXPECT(model.matches(history));
+}
+
+TEST(ui_terminal_history, setWidth) {
+    TerminalHistory history;
+    history.setWidth(10);
+    HistoryModel model{10};
+    Fill(history, model, TerminalHistory::PAGE_LINES * 3);
+    int size = history.size();
+    history.setWidth(7);
+    model.setWidth(7);
+    EXPECT(history.size() > size);
+    EXPECT(model.matches(history));
+    history.setWidth(40);
+    model.setWidth(40);
+    EXPECT(history.size() < size);
+    EXPECT(model.matches(history));
+    // lines appended after the change are wrapped to the new width
+    Fill(history, model, TerminalHistory::PAGE_LINES);
+    EXPECT(model.matches(history));
+}
+
+TEST(ui_terminal_history, trimRows) {
+    TerminalHistory history;
+    history.setWidth(10);
+    HistoryModel model{10};
+    for (size_t i = 0; i < TerminalHistory::PAGE_LINES * 3; ++i)
+        model.append(history, Line(i, 25));
+    history.trim(1000000);
+    // trims a single row of the first line, which is cold
+    history.trim(history.size() - 1);
+    model.trim(1);
+    EXPECT(model.matches(history));
+    // trims the rest of the first page and a row of the first line of the next one
+    history.trim(history.size() - TerminalHistory::PAGE_LINES * 3);
+    model.trim(TerminalHistory::PAGE_LINES * 3);
+    EXPECT(model.matches(history));
+    // the partially trimmed first line is wrapped from its first remaining cell
+    history.setWidth(8);
+    model.setWidth(8);
+    EXPECT(model.matches(history));
+    history.setWidth(10);
+    model.setWidth(10);
+    // trims all lines but the last HOT_LINES, which are hot, and a row of the first of them
+    size_t rows = static_cast<size_t>(history.size()) - TerminalHistory::HOT_LINES * 3 + 1;
+    history.trim(history.size() - static_cast<int>(rows));
+    model.trim(rows);
+    EXPECT(model.matches(history));
+    history.trim(0);
+    EXPECT_EQ(history.size(), 0);
+}
+
+TEST(ui_terminal_history, trimBytes) {
+    TerminalHistory history;
+    history.setWidth(10);
+    HistoryModel model{10};
+    Fill(history, model, TerminalHistory::PAGE_LINES * 6);
+    size_t bytes = history.bytes();
+    int size = history.size();
+    history.trim(1000000, bytes / 2);
+    EXPECT(history.bytes() <= bytes / 2);
+    EXPECT(history.size() < size);
+    model.trim(static_cast<size_t>(size - history.size()));
+    EXPECT(model.matches(history));
+    // a limit nothing fits in deletes all rows
+    history.trim(1000000, 0);
+    EXPECT_EQ(history.size(), 0);
+    EXPECT_EQ(history.memoryBytes(), 0u);
+}
+
+TEST(ui_terminal_history, pagesInFile) {
+    TerminalHistory history;
+    history.setWidth(10);
+    HistoryModel model{10};
+    std::string filename = MakeUnique(JoinPath(TempDir(), "tpp-test-history"));
+    history.setFile(filename, 0);
+    Fill(history, model, TerminalHistory::PAGE_LINES * 4);
+    EXPECT(history.fileBytes() > 0);
+    EXPECT_EQ(history.memoryBytes(), 0u);
+    EXPECT(model.matches(history));
+    // trimming the pages in the file
+    history.trim(history.size() - TerminalHistory::PAGE_LINES * 2);
+    model.trim(TerminalHistory::PAGE_LINES * 2);
+    EXPECT(model.matches(history));
+    // the pages are moved back to memory without the file
+    history.setFile("", 1000000);
+    EXPECT_EQ(history.fileBytes(), 0u);
+    EXPECT(model.matches(history));
+}
+
+TEST(ui_terminal_history, graphemeReferences) {
+    TerminalHistory history;
+    history.setWidth(10);
+    Canvas::Cell cell;
+    cell.setGrapheme(3);
+    history.append(& cell, 1, true);
+    for (size_t i = 0; i < TerminalHistory::PAGE_LINES * 2; ++i) {
+        Canvas::Cell c;
+        c.setCodepoint('a');
+        history.append(& c, 1, true);
+    }
+    history.trim(1000000);
+    std::vector<bool> used;
+    history.markGraphemes(used);
+    EXPECT(used.size() > 3 && used[3]);
+    // the reference is released with the page
+    history.trim(history.size() - TerminalHistory::PAGE_LINES);
+    used.clear();
+    history.markGraphemes(used);
+    EXPECT(used.size() <= 3 || ! used[3]);
+}
@@ -0,0 +1,161 @@
+#include "helpers/tests.h"
+
+#include "../vt_parser.h"
+
+using namespace ui;
+
+namespace {
+
+    /** Records everything the parser reports so that the results of different input splits can be compared.
+
+        Runs of ASCII characters are recorded verbatim since their boundaries depend on the input split.
+     */
+    class VTRecorder : public VTParser {
+    public:
+
+        std::string feed(std::string const & input, size_t chunk) {
+            log_.str("");
+            for (size_t i = 0; i < input.size(); i += chunk) {
+                std::string part{input.substr(i, chunk)};
+                parse(part.c_str(), part.c_str() + part.size());
+            }
+            return log_.str();
+        }
+
+    protected:
+        void parseASCII(char const * begin, char const * end) override {
+            log_ << std::string{begin, end};
+        }
+
+        void parseCodepoint(char32_t codepoint) override {
+            log_ << "U+" << std::hex << static_cast<unsigned>(codepoint) << std::dec << " ";
+        }
+
+        void parseControlCharacter(char c) override {
+            log_ << "C" << static_cast<unsigned>(c) << " ";
+        }
+
+        void parseEscapeSequence(char intermediate, char finalByte) override {
+            log_ << "ESC";
+            if (intermediate != 0)
+                log_ << intermediate;
+            log_ << finalByte << " ";
+        }
+
+        void parseCSISequence(CSISequence & seq) override {
+            log_ << seq << " ";
+        }
+
+        void parseOSCSequence(OSCSequence & seq) override {
+            log_ << seq << " ";
+        }
+
+        void parseOSCStreamStart(OSCSequence & seq) override {
+            log_ << "STREAM" << seq << " ";
+            streamed_.clear();
+        }
+
+        void parseOSCStreamData(char const * data, char const * dataEnd) override {
+            streamed_.append(data, dataEnd);
+        }
+
+        void parseOSCStreamEnd() override {
+            log_ << "STREAMED" << streamed_.size() << " ";
+        }
+
+        void parseTppSequence(char const * payload, char const * payloadEnd) override {
+            log_ << "TPP(" << std::string{payload, payloadEnd} << ") ";
+        }
+
+    private:
+        std::stringstream log_;
+        std::string streamed_;
+    };
+
+    /** Checks that parsing the input split into chunks of any size gives the same result as parsing it at once.
+     */
+    std::string ParseSplit(std::string const & input) {
+        VTRecorder whole;
+        std::string expected{whole.feed(input, input.size())};
+        for (size_t chunk = 1; chunk < input.size(); ++chunk) {
+            VTRecorder split;
+            if (split.feed(input, chunk) != expected)
+                return "chunk " + std::to_string(chunk) + ": " + split.feed(input, chunk);
+        }
+        return expected;
+    }
+
+}
+
+TEST(ui_terminal_vt_parser, text) {
+    EXPECT_EQ(ParseSplit("abc\r\ndef"), "abcC13 C10 def");
+    EXPECT_EQ(ParseSplit("a\xc4\x8d\xe4\xb8\xad" "b"), "aU+10d U+4e2d b");
+}
+
+TEST(ui_terminal_vt_parser, invalidUTF8) {
+    EXPECT_EQ(ParseSplit("\xc4" "a\x80"), "U+fffd aU+fffd ");
+}
+
+TEST(ui_terminal_vt_parser, csi) {
+    EXPECT_EQ(ParseSplit("a\033[1;;31mb"), "a\033[1;;31m b");
+    EXPECT_EQ(ParseSplit("\033[?1049h\033[H"), "\033[?1049h \033[H ");
+    // invalid sequences are ignored
+    EXPECT_EQ(ParseSplit("\033[1 q\033[1<2m"), "");
+    // control characters abort the sequence
+    EXPECT_EQ(ParseSplit("\033[1\nA"), "C10 A");
+}
+
+TEST(ui_terminal_vt_parser, csiSubParameters) {
+    EXPECT_EQ(ParseSplit("\033[38:2::10:20:30;1m"), "\033[38:2::10:20:30;1m ");
+    EXPECT_EQ(ParseSplit("\033[4:3m"), "\033[4:3m ");
+}
+
+TEST(ui_terminal_vt_parser, csiArgumentLimits) {
+    std::string seq{"\033["};
+    for (size_t i = 0; i < CSISequence::MAX_ARGS + 8; ++i) {
+        seq += std::to_string(i);
+        seq += ";";
+    }
+    seq += "m";
+    std::string expected{"\033["};
+    for (size_t i = 0; i < CSISequence::MAX_ARGS; ++i) {
+        if (i != 0)
+            expected += ";";
+        expected += std::to_string(i);
+    }
+    expected += "m ";
+    EXPECT_EQ(ParseSplit(seq), expected);
+    EXPECT_EQ(ParseSplit("\033[99999999999999;2H"), "\033[65535;2H ");
+}
+
+TEST(ui_terminal_vt_parser, escape) {
+    EXPECT_EQ(ParseSplit("\0337\033(0\033M"), "ESC7 ESC(0 ESCM ");
+}
+
+TEST(ui_terminal_vt_parser, osc) {
+    EXPECT_EQ(ParseSplit("\033]0;title\007x"), "\033]0;title x");
+    EXPECT_EQ(ParseSplit("\033]8;;http://x.org\033\\x"), "\033]8;;http://x.org x");
+    EXPECT_EQ(ParseSplit("\033]52;c;SGVsbG8=\033\\"), "\033]52;c;SGVsbG8= ");
+    EXPECT_EQ(ParseSplit("\033]112\007"), "\033]112 ");
+    EXPECT_EQ(ParseSplit("\033]foo\007"), "Invalid OSC Sequence ");
+}
+
+TEST(ui_terminal_vt_parser, dcs) {
+    EXPECT_EQ(ParseSplit("\033P+3;payload\007x"), "TPP(3;payload) x");
+    // unknown DCS sequences are ignored
+    EXPECT_EQ(ParseSplit("\033Pq#0;2;0;0;0\033\\x"), "x");
+    // empty DCS sequences are terminated as well
+    EXPECT_EQ(ParseSplit("\033P\033\\x"), "x");
+    EXPECT_EQ(ParseSplit("\033P\007x"), "x");
+}
+
+TEST(ui_terminal_vt_parser, oscStream) {
+    std::string data(VTParser::OSC_STREAM_THRESHOLD * 2, 'x');
+    for (std::string terminator : { "\007", "\033\\" }) {
+        std::string input{"\033]52;c;" + data + terminator + "y"};
+        for (size_t chunk : { static_cast<size_t>(1000), static_cast<size_t>(4095), input.size() - 2 }) {
+            VTRecorder r;
+            EXPECT_EQ(r.feed(input, chunk), "STREAM\033]52;c STREAMED" + std::to_string(data.size()) + " y");
+        }
+    }
+}
@@ -0,0 +1,641 @@
+#pragma once
+
+#include <cstring>
+#include <string>
+
+#include "helpers/helpers.h"
+#include "helpers/char.h"
+
+#include "csi_sequence.h"
+#include "osc_sequence.h"
+
+namespace ui {
+
+    /** Resumable table-driven parser of the terminal input.
+
+        The parser is a state machine whose state is kept between calls to parse() so that a sequence split across multiple reads from the PTY continues where the previous read ended and no byte is ever scanned twice. Each byte is first mapped to its class and the pair of current state and byte class is then looked up in the transition table to determine the action to take and the next state.
+
+        Runs of printable ASCII characters and the payloads of OSC and DCS sequences are scanned in bulk. Payloads are passed to the handlers directly from the input buffer if the whole sequence was received in a single call, otherwise the parts received so far are accumulated in the parser.
+
+        The parsed input is passed to the virtual handlers which must be implemented by the subclasses.
+     */
+    class VTParser {
+    public:
+
+        /** States of the parser.
+         */
+        enum class State : unsigned char {
+            Ground,
+            /** Inside multibyte UTF8 character. */
+            UTF8,
+            Escape,
+            /** Escape sequence with an intermediate byte, such as character set selection, i.e. `ESC ( 0`. */
+            EscapeIntermediate,
+            CSIEntry,
+            CSIParam,
+            CSIIntermediate,
+            OSCString,
+            /** Escape character inside OSC sequence, which may be the beginning of its string terminator. */
+            OSCEscape,
+            DCSEntry,
+            /** The t++ sequence payload, i.e. `ESC P +` up to the terminating BEL. */
+            Tpp,
+            /** Unknown DCS sequences and payloads of sequences too long to be kept are ignored up to their terminator. */
+            Ignore,
+            IgnoreEscape,
+        };
+
+        /** Maximum size of the t++ sequence payloads that will be kept by the parser.
+
+            Longer sequences are ignored.
+         */
+        static constexpr size_t MAX_PAYLOAD_SIZE = 16 * 1024 * 1024;
+
+        /** OSC sequences with payloads larger than this are not kept by the parser, but streamed to the parseOSCStream handlers in chunks.
+         */
+        static constexpr size_t OSC_STREAM_THRESHOLD = 64 * 1024;
+
+        /** Codepoint reported for invalid UTF8 encodings.
+         */
+        static constexpr char32_t REPLACEMENT_CHARACTER = 0xfffd;
+
+        virtual ~VTParser() = default;
+
+        State state() const {
+            return state_;
+        }
+
+    protected:
+
+        /** Parses the given input.
+
+            All of the input is always consumed, any incomplete sequence or character at the end is remembered and continued with the next call.
+         */
+        void parse(char const * buffer, char const * bufferEnd) {
+            char const * x = buffer;
+            // beginning of the payload in current buffer, payloads continued from previous calls start at the buffer's beginning
+            char const * payloadStart = buffer;
+            while (x != bufferEnd) {
+                unsigned char c = static_cast<unsigned char>(*x);
+                Transition const & t = Transitions(state_, ByteClasses()[c]);
+                state_ = t.next;
+                switch (t.action) {
+                    case Action::None:
+                        ++x;
+                        break;
+                    case Action::Print: {
+                        char const * runEnd = FindNonPrintableASCII(x + 1, bufferEnd);
+                        parseASCII(x, runEnd);
+                        x = runEnd;
+                        break;
+                    }
+                    case Action::PrintCodepoint:
+                        parseCodepoint(c);
+                        ++x;
+                        break;
+                    case Action::Execute:
+                        parseControlCharacter(*x);
+                        ++x;
+                        break;
+                    case Action::UTF8Start:
+                        // the number of continuation bytes is determined from the number of leading ones
+                        if (c < 0xe0) {
+                            codepoint_ = c & 0x1f;
+                            utf8Remaining_ = 1;
+                        } else if (c < 0xf0) {
+                            codepoint_ = c & 0x0f;
+                            utf8Remaining_ = 2;
+                        } else {
+                            codepoint_ = c & 0x07;
+                            utf8Remaining_ = 3;
+                        }
+                        ++x;
+                        break;
+                    case Action::UTF8Continue:
+                        codepoint_ = (codepoint_ << 6) + (c & 0x3f);
+                        ++x;
+                        if (--utf8Remaining_ == 0) {
+                            state_ = State::Ground;
+                            parseCodepoint(codepoint_);
+                        }
+                        break;
+                    case Action::Replace:
+                        parseCodepoint(REPLACEMENT_CHARACTER);
+                        ++x;
+                        break;
+                    case Action::ReplaceAndReprocess:
+                        parseCodepoint(REPLACEMENT_CHARACTER);
+                        break;
+                    case Action::EscapeDispatch:
+                        ++x;
+                        switch (c) {
+                            case '[':
+                                csi_.reset();
+                                state_ = State::CSIEntry;
+                                break;
+                            case ']':
+                                payload_.clear();
+                                payloadStart = x;
+                                state_ = State::OSCString;
+                                break;
+                            case 'P':
+                                state_ = State::DCSEntry;
+                                break;
+                            default:
+                                parseEscapeSequence(0, static_cast<char>(c));
+                                break;
+                        }
+                        break;
+                    case Action::EscapeIntermediate:
+                        escapeIntermediate_ = static_cast<char>(c);
+                        ++x;
+                        break;
+                    case Action::EscapeIntermediateDispatch:
+                        ++x;
+                        parseEscapeSequence(escapeIntermediate_, static_cast<char>(c));
+                        break;
+                    case Action::CSIFirstByte:
+                        csi_.firstByte_ = static_cast<char>(c);
+                        ++x;
+                        break;
+                    case Action::CSIDigit:
+                        csi_.parseDigit(*x);
+                        ++x;
+                        break;
+                    case Action::CSISeparator:
+                        csi_.parseSeparator(*x);
+                        ++x;
+                        break;
+                    case Action::CSIInvalid:
+                        csi_.firstByte_ = CSISequence::INVALID;
+                        ++x;
+                        break;
+                    case Action::CSIDispatch:
+                        csi_.finalByte_ = static_cast<char>(c);
+                        ++x;
+                        // invalid sequences are silently ignored
+                        if (csi_.valid())
+                            parseCSISequence(csi_);
+                        break;
+                    case Action::Reprocess:
+                        break;
+                    case Action::Put:
+                        x = (state_ == State::Tpp) ? FindByte(x + 1, bufferEnd, Char::BEL) : FindTerminator(x + 1, bufferEnd);
+                        break;
+                    case Action::OSCEnd:
+                        dispatchOSC(payloadStart, x);
+                        ++x;
+                        break;
+                    case Action::OSCEscape:
+                        if (c == '\\') {
+                            state_ = State::Ground;
+                            // the escape character may have been the last byte of the previous call
+                            if (x == buffer) {
+                                payload_.pop_back();
+                                dispatchOSC(payloadStart, x);
+                            } else {
+                                dispatchOSC(payloadStart, x - 1);
+                            }
+                            ++x;
+                        } else {
+                            // escape not followed by backslash is part of the OSC string
+                            state_ = State::OSCString;
+                        }
+                        break;
+                    case Action::DCSEntry:
+                        ++x;
+                        if (c == '+') {
+                            payload_.clear();
+                            payloadStart = x;
+                            state_ = State::Tpp;
+                        }
+                        break;
+                    case Action::TppEnd:
+                        // the payload end points to the terminating BEL
+                        if (payload_.empty()) {
+                            parseTppSequence(payloadStart, x);
+                        } else {
+                            payload_.append(payloadStart, x + 1);
+                            parseTppSequence(payload_.data(), payload_.data() + payload_.size() - 1);
+                        }
+                        ++x;
+                        break;
+                    case Action::IgnoreEscape:
+                        if (c == '\\') {
+                            state_ = State::Ground;
+                            ++x;
+                        } else {
+                            state_ = State::Ignore;
+                        }
+                        break;
+                    default:
+                        UNREACHABLE;
+                }
+            }
+            // keep the payload received so far for sequences that continue in the next call
+            if (state_ == State::OSCString || state_ == State::OSCEscape) {
+                if (oscStreaming_) {
+                    streamOSC(payloadStart, bufferEnd);
+                } else {
+                    payload_.append(payloadStart, bufferEnd);
+                    if (payload_.size() > OSC_STREAM_THRESHOLD)
+                        startOSCStream();
+                }
+            } else if (state_ == State::Tpp) {
+                payload_.append(payloadStart, bufferEnd);
+                if (payload_.size() > MAX_PAYLOAD_SIZE) {
+                    payload_.clear();
+                    state_ = State::Ignore;
+                }
+            }
+        }
+
+        /** Called for each run of printable ASCII characters.
+         */
+        virtual void parseASCII(char const * begin, char const * end) = 0;
+
+        /** Called for other codepoints, including the C0 control characters that are not executed.
+
+            Invalid UTF8 encodings are reported as the replacement character.
+         */
+        virtual void parseCodepoint(char32_t codepoint) = 0;
+
+        /** Called for the executed control characters, i.e. BEL, TAB, LF, CR and backspace.
+         */
+        virtual void parseControlCharacter(char c) = 0;
+
+        /** Called for escape sequences other than CSI, OSC and DCS.
+
+            The intermediate is 0 for single character sequences.
+         */
+        virtual void parseEscapeSequence(char intermediate, char finalByte) = 0;
+
+        /** Called for each complete and valid CSI sequence.
+         */
+        virtual void parseCSISequence(CSISequence & seq) = 0;
+
+        /** Called for each complete OSC sequence.
+         */
+        virtual void parseOSCSequence(OSCSequence & seq) = 0;
+
+        /** Called when an OSC sequence too large to be kept is encountered.
+
+            The sequence contains the number and all values but the last one, which is then passed in chunks to parseOSCStreamData(). The values are valid only for the duration of the call. The default implementation does nothing, i.e. oversized sequences are ignored.
+         */
+        virtual void parseOSCStreamStart(OSCSequence & seq) {
+            MARK_AS_UNUSED(seq);
+        }
+
+        virtual void parseOSCStreamData(char const * data, char const * dataEnd) {
+            MARK_AS_UNUSED(data);
+            MARK_AS_UNUSED(dataEnd);
+        }
+
+        /** Called when the streamed OSC sequence is terminated.
+         */
+        virtual void parseOSCStreamEnd() {
+        }
+
+        /** Called for each complete t++ sequence.
+
+            The payload excludes the leading `ESC P +`, the payload end points to the terminating BEL character.
+         */
+        virtual void parseTppSequence(char const * payload, char const * payloadEnd) = 0;
+
+    private:
+
+        /** Classes of the input bytes, each class is a column in the transition table.
+         */
+        enum class ByteClass : unsigned char {
+            /** C0 control characters other than those below. */
+            C0,
+            /** Executed control characters (TAB, LF, CR and backspace). */
+            Execute,
+            Bel,
+            Esc,
+            /** 0x20 - 0x2f */
+            Intermediate,
+            Digit,
+            Colon,
+            Semicolon,
+            /** Private parameter markers `<`, `=`, `>` and `?`. */
+            Marker,
+            /** 0x40 - 0x7e */
+            Final,
+            Del,
+            UTF8Continuation,
+            UTF8Lead,
+            /** Bytes that can't appear in valid UTF8. */
+            UTF8Invalid,
+        };
+
+        enum class Action : unsigned char {
+            None,
+            Print,
+            PrintCodepoint,
+            Execute,
+            UTF8Start,
+            UTF8Continue,
+            Replace,
+            ReplaceAndReprocess,
+            EscapeDispatch,
+            EscapeIntermediate,
+            EscapeIntermediateDispatch,
+            CSIFirstByte,
+            CSIDigit,
+            CSISeparator,
+            CSIInvalid,
+            CSIDispatch,
+            Reprocess,
+            Put,
+            OSCEnd,
+            OSCEscape,
+            DCSEntry,
+            TppEnd,
+            IgnoreEscape,
+        };
+
+        struct Transition {
+            Action action;
+            State next;
+        };
+
+        static constexpr size_t NUM_STATES = static_cast<size_t>(State::IgnoreEscape) + 1;
+        static constexpr size_t NUM_BYTE_CLASSES = static_cast<size_t>(ByteClass::UTF8Invalid) + 1;
+
+        struct ByteClassTable {
+            ByteClass classes[256];
+            constexpr ByteClass operator [] (unsigned char c) const { return classes[c]; }
+        };
+
+        struct TransitionTable {
+            Transition transitions[NUM_STATES][NUM_BYTE_CLASSES];
+        };
+
+        static constexpr ByteClass ClassOf(unsigned c) {
+            switch (c) {
+                case Char::BEL:
+                    return ByteClass::Bel;
+                case Char::ESC:
+                    return ByteClass::Esc;
+                case Char::TAB:
+                case Char::LF:
+                case Char::CR:
+                case Char::BACKSPACE:
+                    return ByteClass::Execute;
+                case ':':
+                    return ByteClass::Colon;
+                case ';':
+                    return ByteClass::Semicolon;
+                case 0x7f:
+                    return ByteClass::Del;
+                default:
+                    break;
+            }
+            if (c < 0x20)
+                return ByteClass::C0;
+            if (c < 0x30)
+                return ByteClass::Intermediate;
+            if (c < 0x3a)
+                return ByteClass::Digit;
+            if (c < 0x40)
+                return ByteClass::Marker;
+            if (c < 0x7f)
+                return ByteClass::Final;
+            if (c < 0xc0)
+                return ByteClass::UTF8Continuation;
+            if (c < 0xf8)
+                return ByteClass::UTF8Lead;
+            return ByteClass::UTF8Invalid;
+        }
+
+        /** Determines the action and next state for given state and byte class.
+
+            Used only to build the transition table at compile time.
+         */
+        static constexpr Transition Next(State state, ByteClass c) {
+            switch (state) {
+                case State::Ground:
+                    switch (c) {
+                        case ByteClass::C0:
+                        case ByteClass::Del:
+                            return Transition{Action::PrintCodepoint, State::Ground};
+                        case ByteClass::Execute:
+                        case ByteClass::Bel:
+                            return Transition{Action::Execute, State::Ground};
+                        case ByteClass::Esc:
+                            return Transition{Action::None, State::Escape};
+                        case ByteClass::UTF8Lead:
+                            return Transition{Action::UTF8Start, State::UTF8};
+                        case ByteClass::UTF8Continuation:
+                        case ByteClass::UTF8Invalid:
+                            return Transition{Action::Replace, State::Ground};
+                        default:
+                            return Transition{Action::Print, State::Ground};
+                    }
+                case State::UTF8:
+                    if (c == ByteClass::UTF8Continuation)
+                        return Transition{Action::UTF8Continue, State::UTF8};
+                    return Transition{Action::ReplaceAndReprocess, State::Ground};
+                case State::Escape:
+                    if (c == ByteClass::Intermediate)
+                        return Transition{Action::EscapeIntermediate, State::EscapeIntermediate};
+                    return Transition{Action::EscapeDispatch, State::Ground};
+                case State::EscapeIntermediate:
+                    return Transition{Action::EscapeIntermediateDispatch, State::Ground};
+                case State::CSIEntry:
+                case State::CSIParam:
+                    switch (c) {
+                        case ByteClass::Digit:
+                            return Transition{Action::CSIDigit, State::CSIParam};
+                        case ByteClass::Colon:
+                        case ByteClass::Semicolon:
+                            return Transition{Action::CSISeparator, State::CSIParam};
+                        case ByteClass::Marker:
+                            // the first byte of the sequence may be a non-numeric parameter byte
+                            if (state == State::CSIEntry)
+                                return Transition{Action::CSIFirstByte, State::CSIParam};
+                            return Transition{Action::CSIInvalid, State::CSIParam};
+                        // intermediate bytes are not supported
+                        case ByteClass::Intermediate:
+                            return Transition{Action::CSIInvalid, State::CSIIntermediate};
+                        case ByteClass::Final:
+                        case ByteClass::Del:
+                            return Transition{Action::CSIDispatch, State::Ground};
+                        // any other byte aborts the sequence and is processed as if outside of it
+                        default:
+                            return Transition{Action::Reprocess, State::Ground};
+                    }
+                case State::CSIIntermediate:
+                    switch (c) {
+                        case ByteClass::Intermediate:
+                            return Transition{Action::None, State::CSIIntermediate};
+                        case ByteClass::Final:
+                        case ByteClass::Del:
+                            return Transition{Action::CSIDispatch, State::Ground};
+                        default:
+                            return Transition{Action::Reprocess, State::Ground};
+                    }
+                case State::OSCString:
+                    switch (c) {
+                        case ByteClass::Bel:
+                            return Transition{Action::OSCEnd, State::Ground};
+                        case ByteClass::Esc:
+                            return Transition{Action::None, State::OSCEscape};
+                        default:
+                            return Transition{Action::Put, State::OSCString};
+                    }
+                case State::OSCEscape:
+                    return Transition{Action::OSCEscape, State::OSCString};
+                case State::DCSEntry:
+                    switch (c) {
+                        // the parameter and intermediate bytes, one of which may be the t++ sequence marker
+                        case ByteClass::Digit:
+                        case ByteClass::Colon:
+                        case ByteClass::Semicolon:
+                        case ByteClass::Marker:
+                        case ByteClass::Intermediate:
+                            return Transition{Action::DCSEntry, State::Ignore};
+                        // empty sequence terminated by BEL or ST
+                        case ByteClass::Bel:
+                            return Transition{Action::None, State::Ground};
+                        case ByteClass::Esc:
+                            return Transition{Action::None, State::IgnoreEscape};
+                        default:
+                            return Transition{Action::Reprocess, State::Ignore};
+                    }
+                case State::Tpp:
+                    if (c == ByteClass::Bel)
+                        return Transition{Action::TppEnd, State::Ground};
+                    return Transition{Action::Put, State::Tpp};
+                case State::Ignore:
+                    switch (c) {
+                        case ByteClass::Bel:
+                            return Transition{Action::None, State::Ground};
+                        case ByteClass::Esc:
+                            return Transition{Action::None, State::IgnoreEscape};
+                        default:
+                            return Transition{Action::Put, State::Ignore};
+                    }
+                case State::IgnoreEscape:
+                    return Transition{Action::IgnoreEscape, State::Ignore};
+            }
+            return Transition{Action::None, State::Ground};
+        }
+
+        static constexpr ByteClassTable BuildByteClasses() {
+            ByteClassTable result{};
+            for (unsigned c = 0; c < 256; ++c)
+                result.classes[c] = ClassOf(c);
+            return result;
+        }
+
+        static constexpr TransitionTable BuildTransitions() {
+            TransitionTable result{};
+            for (size_t s = 0; s < NUM_STATES; ++s)
+                for (size_t c = 0; c < NUM_BYTE_CLASSES; ++c)
+                    result.transitions[s][c] = Next(static_cast<State>(s), static_cast<ByteClass>(c));
+            return result;
+        }
+
+        static ByteClassTable const & ByteClasses() {
+            static constexpr ByteClassTable table = BuildByteClasses();
+            return table;
+        }
+
+        static Transition const & Transitions(State state, ByteClass c) {
+            static constexpr TransitionTable table = BuildTransitions();
+            return table.transitions[static_cast<size_t>(state)][static_cast<size_t>(c)];
+        }
+
+        /** Returns the first BEL or ESC character in the given range, or its end.
+         */
+        static char const * FindTerminator(char const * begin, char const * end) {
+            while (begin != end && *begin != Char::BEL && *begin != Char::ESC)
+                ++begin;
+            return begin;
+        }
+
+        static char const * FindByte(char const * begin, char const * end, char what) {
+            char const * result = static_cast<char const *>(memchr(begin, what, end - begin));
+            return result == nullptr ? end : result;
+        }
+
+        /** Dispatches the OSC sequence whose payload ends at given position in the current buffer.
+         */
+        void dispatchOSC(char const * payloadStart, char const * payloadEnd) {
+            if (oscStreaming_) {
+                streamOSC(payloadStart, payloadEnd);
+                oscStreaming_ = false;
+                parseOSCStreamEnd();
+            } else if (payload_.empty()) {
+                OSCSequence seq{OSCSequence::Parse(payloadStart, payloadEnd)};
+                parseOSCSequence(seq);
+            } else {
+                payload_.append(payloadStart, payloadEnd);
+                OSCSequence seq{OSCSequence::Parse(payload_.data(), payload_.data() + payload_.size())};
+                parseOSCSequence(seq);
+            }
+        }
+
+        /** Starts streaming the accumulated OSC payload.
+
+            The last value, i.e. everything after the last semicolon, is streamed and the rest of the payload forms the header passed to parseOSCStreamStart().
+         */
+        void startOSCStream() {
+            // the escape character at the end may be the beginning of the string terminator and is kept for the next call
+            size_t end = payload_.size();
+            if (state_ == State::OSCEscape)
+                --end;
+            size_t separator = payload_.rfind(';', end);
+            if (separator == std::string::npos)
+                separator = end;
+            OSCSequence seq{OSCSequence::Parse(payload_.data(), payload_.data() + separator)};
+            oscStreaming_ = true;
+            parseOSCStreamStart(seq);
+            if (separator + 1 < end)
+                parseOSCStreamData(payload_.data() + separator + 1, payload_.data() + end);
+            payload_.erase(0, end);
+        }
+
+        /** Passes the streamed OSC data received so far and the given part of the current buffer to the handler.
+         */
+        void streamOSC(char const * begin, char const * end) {
+            // the escape character at the end may be the beginning of the string terminator and is kept for the next call
+            bool keepEscape = (state_ == State::OSCEscape);
+            if (keepEscape)
+                --end;
+            if (! payload_.empty()) {
+                parseOSCStreamData(payload_.data(), payload_.data() + payload_.size());
+                payload_.clear();
+            }
+            if (begin != end)
+                parseOSCStreamData(begin, end);
+            if (keepEscape)
+                payload_.push_back(Char::ESC);
+        }
+
+        State state_ = State::Ground;
+
+        /** The UTF8 character being decoded and the number of continuation bytes it still expects.
+         */
+        char32_t codepoint_ = 0;
+        unsigned utf8Remaining_ = 0;
+
+        char escapeIntermediate_ = 0;
+
+        /** The CSI sequence being parsed.
+         */
+        CSISequence csi_;
+
+        /** Payload of the OSC or t++ sequence received in previous calls.
+         */
+        std::string payload_;
+
+        /** True if the OSC sequence being parsed is too large and its payload is streamed to the handler.
+         */
+        bool oscStreaming_ = false;
+
+    }; // ui::VTParser
+
+} // namespace ui
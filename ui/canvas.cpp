@@ -5,8 +5,10 @@
 
 namespace ui {
 
-    std::unordered_map<Canvas::Cell *, Canvas::SpecialObject *> Canvas::SpecialObject::Objects_;
-    std::mutex Canvas::SpecialObject::MObjects_;
+    std::atomic<Canvas::SpecialObject **> Canvas::SpecialObject::Chunks_[MAX_CHUNKS];
+    std::vector<uint32_t> Canvas::SpecialObject::FreeHandles_;
+    uint32_t Canvas::SpecialObject::NextHandle_ = 1;
+    std::mutex Canvas::SpecialObject::MHandles_;
 
     Canvas::Canvas(Buffer & buffer, VisibleArea const & visibleArea, Size const & size):
         visibleArea_{visibleArea},
@@ -61,7 +63,9 @@ namespace ui {
         Point bufferOffset = at + visibleArea_.offset();
         for (int row = r.top(), re = r.bottom(); row < re; ++row) {
             for (int col = r.left(), ce = r.right(); col < ce; ++col) {
-                buffer_->at(col, row) = buffer.at(col - bufferOffset.x(), row - bufferOffset.y());
+                Cell & c = buffer_->at(col, row);
+                c = buffer.at(col - bufferOffset.x(), row - bufferOffset.y());
+                buffer_->importGrapheme(c, buffer.graphemes());
             }
         }
         return *this;
@@ -74,7 +78,22 @@ namespace ui {
         Point bufferOffset = at + visibleArea_.offset();
         for (int row = r.top(), re = r.bottom(); row < re; ++row) {
             for (int col = r.left(), ce = r.right(); col < ce; ++col) {
-                buffer_->at(col, row).stripSpecialObjectAndAssign(buffer.at(col - bufferOffset.x(), row - bufferOffset.y()));
+                Cell & c = buffer_->at(col, row);
+                c.stripSpecialObjectAndAssign(buffer.at(col - bufferOffset.x(), row - bufferOffset.y()));
+                buffer_->importGrapheme(c, buffer.graphemes());
+            }
+        }
+        return *this;
+    }
+
+    Canvas & Canvas::drawFallbackCells(Cell const * cells, int count, Point at, GraphemeTable const & graphemes) {
+        Rect r = (Rect{at, Size{count, 1}} & visibleArea_.rect()) + visibleArea_.offset();
+        Point cellsOffset = at + visibleArea_.offset();
+        for (int row = r.top(), re = r.bottom(); row < re; ++row) {
+            for (int col = r.left(), ce = r.right(); col < ce; ++col) {
+                Cell & c = buffer_->at(col, row);
+                c.stripSpecialObjectAndAssign(cells[col - cellsOffset.x()]);
+                buffer_->importGrapheme(c, graphemes);
             }
         }
         return *this;
@@ -108,19 +127,19 @@ namespace ui {
 
     Canvas & Canvas::fill(Rect const & rect, Cell const & fill) {
         Rect r = (rect & visibleArea_.rect()) + visibleArea_.offset();
-        for (int y = r.top(), ye = r.bottom(); y < ye; ++y) {
-            for (int x = r.left(), xe = r.right(); x < xe; ++x) {
-                buffer_->at(x,y) = fill;
-            }
-        }
+        for (int y = r.top(), ye = r.bottom(); y < ye; ++y)
+            buffer_->fillRow(y, fill, r.left(), r.width());
         return *this;
-
     }
 
     Canvas & Canvas::textOut(Point x, Char::iterator_utf8 begin, Char::iterator_utf8 end) {
         Rect vr = visibleArea_.rect() + visibleArea_.offset();
         x = x + visibleArea_.offset();
         for (; begin != end; ++begin) {
+            int columnWidth = Char::ColumnWidth(*begin);
+            // zero width characters can't be displayed on their own
+            if (columnWidth == 0)
+                continue;
             if (vr.contains(x)) {
                 Cell & c = buffer_->at(x);
                 c.detachSpecialObject();
@@ -130,7 +149,7 @@ namespace ui {
                 c.setFont(font_);
                 c.setCodepoint(begin->codepoint());
             }
-            x.setX(x.x() + Char::ColumnWidth(*begin) * font_.width());
+            x.setX(x.x() + columnWidth * font_.width());
         }
         return *this;
     }
@@ -210,24 +229,153 @@ namespace ui {
 
     // Canvas::SpecialObject
 
-    void Canvas::SpecialObject::detachFromAllCells() {
-        {
-            std::lock_guard<std::mutex> g{SpecialObject::MObjects_};
-            for (auto i = Objects_.begin(), e = Objects_.end(); i != e; ++i) {
-                if (i->second == this) {
-                    --refCount_;
-                    i->first->codepoint_ &= ~ Cell::SPECIAL_OBJECT;
-                    auto tmp = i;
-                    ++i;
-                    Objects_.erase(tmp);
-                } else {
-                    ++i;
-                }
+    Canvas::SpecialObject::~SpecialObject() {
+        uint32_t handle = handle_.load(std::memory_order_acquire);
+        if (handle != 0) {
+            std::lock_guard<std::mutex> g{MHandles_};
+            Chunks_[handle >> CHUNK_BITS].load(std::memory_order_relaxed)[handle & (CHUNK_SIZE - 1)] = nullptr;
+            FreeHandles_.push_back(handle);
+        }
+    }
+
+    /** The handle 0 is never used so that it can denote cells without special objects. 
+     */
+    uint32_t Canvas::SpecialObject::obtainHandle() {
+        std::lock_guard<std::mutex> g{MHandles_};
+        // another thread might have obtained the handle in the meantime
+        uint32_t result = handle_.load(std::memory_order_relaxed);
+        if (result != 0)
+            return result;
+        if (! FreeHandles_.empty()) {
+            result = FreeHandles_.back();
+            FreeHandles_.pop_back();
+        } else {
+            result = NextHandle_++;
+            if ((result >> CHUNK_BITS) >= MAX_CHUNKS)
+                THROW(Exception()) << "Too many special objects";
+            if ((result & (CHUNK_SIZE - 1)) == 0 || result == 1)
+                Chunks_[result >> CHUNK_BITS].store(new SpecialObject *[CHUNK_SIZE], std::memory_order_release);
+        }
+        Chunks_[result >> CHUNK_BITS].load(std::memory_order_relaxed)[result & (CHUNK_SIZE - 1)] = this;
+        handle_.store(result, std::memory_order_release);
+        return result;
+    }
+
+    // Canvas::StyleTable
+
+    Canvas::PackedCell Canvas::StyleTable::pack(Cell const & cell) {
+        for (uint32_t id : recent_) {
+            if (id != EMPTY && SameStyle(styles_[id].style, cell)) {
+                if (styles_[id].refs++ == 0)
+                    --unused_;
+                return PackedCell{cell.codepoint_, id};
             }
+        }
+        // keep the index at most half full
+        if ((styles_.size() - freeIds_.size() + 1) * 2 > index_.size())
+            rebuildIndex(std::max(index_.size() * 2, static_cast<size_t>(64)));
+        size_t mask = index_.size() - 1;
+        size_t slot = StyleHash(cell) & mask;
+        for (; index_[slot] != EMPTY; slot = (slot + 1) & mask) {
+            Style & s = styles_[index_[slot]];
+            if (SameStyle(s.style, cell)) {
+                if (s.refs++ == 0)
+                    --unused_;
+                recent_[nextRecent_++ % RECENT] = index_[slot];
+                return PackedCell{cell.codepoint_, index_[slot]};
+            }
+        }
+        uint32_t id;
+        if (freeIds_.empty()) {
+            id = static_cast<uint32_t>(styles_.size());
+            styles_.push_back(Style{cell, 1});
+        } else {
+            id = freeIds_.back();
+            freeIds_.pop_back();
+            styles_[id] = Style{cell, 1};
+        }
+        styles_[id].style.codepoint_ = 0;
+        if (cell.hasSpecialObject())
+            addSpecialObject(cell.specialObject());
+        index_[slot] = id;
+        recent_[nextRecent_++ % RECENT] = id;
+        return PackedCell{cell.codepoint_, id};
+    }
+
+    void Canvas::StyleTable::release(uint32_t id, uint32_t refs) {
+        ASSERT(id < styles_.size() && styles_[id].refs >= refs);
+        styles_[id].refs -= refs;
+        if (styles_[id].refs == 0 && ++unused_ > std::max(MIN_UNUSED, size()))
+            collect();
+    }
+
+    void Canvas::StyleTable::collect() {
+        if (unused_ == 0)
+            return;
+        std::vector<bool> freed(styles_.size(), false);
+        for (uint32_t id : freeIds_)
+            freed[id] = true;
+        for (uint32_t id = 0, e = static_cast<uint32_t>(styles_.size()); id < e; ++id) {
+            if (styles_[id].refs == 0 && ! freed[id]) {
+                if (styles_[id].style.hasSpecialObject())
+                    removeSpecialObject(styles_[id].style.specialObject());
+                // detaches the special object, if any
+                styles_[id].style = Cell{};
+                freeIds_.push_back(id);
+            }
+        }
+        unused_ = 0;
+        std::fill(recent_, recent_ + RECENT, EMPTY);
+        rebuildIndex(index_.size());
+    }
+
+    void Canvas::StyleTable::rebuildIndex(size_t capacity) {
+        std::vector<bool> freed(styles_.size(), false);
+        for (uint32_t id : freeIds_)
+            freed[id] = true;
+        index_.assign(capacity, EMPTY);
+        size_t mask = capacity - 1;
+        for (uint32_t id = 0, e = static_cast<uint32_t>(styles_.size()); id < e; ++id) {
+            if (freed[id])
+                continue;
+            size_t slot = StyleHash(styles_[id].style) & mask;
+            while (index_[slot] != EMPTY)
+                slot = (slot + 1) & mask;
+            index_[slot] = id;
+        }
+    }
 
+    void Canvas::StyleTable::addSpecialObject(SpecialObject * so) {
+        auto & entry = specialObjects_[so];
+        if (entry.first++ == 0) {
+            entry.second = so->bytes();
+            specialObjectBytes_ += entry.second;
         }
-        if (refCount_ == 0)
-            delete this;
+    }
+
+    void Canvas::StyleTable::removeSpecialObject(SpecialObject * so) {
+        auto i = specialObjects_.find(so);
+        ASSERT(i != specialObjects_.end());
+        if (--i->second.first == 0) {
+            specialObjectBytes_ -= i->second.second;
+            specialObjects_.erase(i);
+        }
+    }
+
+    size_t Canvas::StyleTable::StyleHash(Cell const & cell) {
+        auto raw = [](auto const & x) {
+            uint64_t result = 0;
+            memcpy(& result, & x, std::min(sizeof(x), sizeof(result)));
+            return result;
+        };
+        uint64_t result = cell.specialObject_;
+        result = result * 31 + raw(cell.fg_);
+        result = result * 31 + raw(cell.bg_);
+        result = result * 31 + raw(cell.decor_);
+        result = result * 31 + raw(cell.font_);
+        result = result * 31 + raw(cell.border_);
+        // mix the high bits in as the index only uses the low ones
+        return static_cast<size_t>(result ^ (result >> 29) ^ (result >> 47));
     }
 
 } // namespace ui
\ No newline at end of file
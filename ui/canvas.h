@@ -1,5 +1,11 @@
 #pragma once
 
+#include <algorithm>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
 #include "font.h"
 #include "color.h"
 #include "border.h"
@@ -18,6 +24,9 @@ namespace ui {
         class Cursor;
         class SpecialObject;
         class Cell;
+        class PackedCell;
+        class StyleTable;
+        class GraphemeTable;
         class Buffer;
 
         explicit Canvas(Buffer & buffer);
@@ -127,6 +136,12 @@ namespace ui {
          */
         Canvas & drawFallbackBuffer(Buffer const & buffer, Point at);
 
+        /** Draws a row of fallback cells, starting at the given coordinates. 
+         
+            Like drawFallbackBuffer(), but the cells do not have to come from a buffer, only the grapheme table their grapheme clusters refer to must be provided. 
+         */
+        Canvas & drawFallbackCells(Cell const * cells, int count, Point at, GraphemeTable const & graphemes);
+
         Canvas & fill(Rect const & rect) {
             return fill(rect, bg_);
         }
@@ -327,7 +342,7 @@ namespace ui {
 
         Special object manipulation (i.e. attaching and detaching from cells and pointers) is thread safe as long as the cell or pointer access is thread safe (the pointer or the cell cannot be accessed concurrently, but two unrelated cells or pointers can attach and detach to the same special object).
 
-        Internally, the SpecialObject holds a map from cell addresses to special objects for the cells that have special object attached. Each cell then has a bit flag that determines whether an attachment to special object exists, or not. 
+        Internally, each special object attached to a cell gets a 32bit handle, which is stored in the cell. The handles index a table of chunks of special object pointers, so that the object of a cell can be found without any lookups, or locking, and the reference count of the object is atomic. Only obtaining and releasing the handle, i.e. when the object is first attached to a cell and when it is deleted, locks the table. 
      */
     class Canvas::SpecialObject {
         friend class Cell;
@@ -360,25 +375,13 @@ namespace ui {
             }
 
             Ptr & operator = (Ptr const & other) {
-                if (ptr_ != other.ptr_) {
-                    std::lock_guard<std::mutex> g{SpecialObject::MObjects_};
-                    if (ptr_ != nullptr && --ptr_->refCount_ == 0)
-                        delete ptr_;
-                    ptr_ = other.ptr_;
-                    if (ptr_ != nullptr)
-                        ++ptr_->refCount_;
-                }
-                return *this;
+                return *this = other.ptr_;
             }
 
             Ptr & operator = (T * other) {
                 if (ptr_ != other) {
-                    std::lock_guard<std::mutex> g{SpecialObject::MObjects_};
-                    if (ptr_ != nullptr && --(ptr_->refCount_) == 0)
-                        delete ptr_;
-                    ptr_ = other;
-                    if (ptr_ != nullptr)
-                        ++ptr_->refCount_;
+                    detach();
+                    attach(other);
                 }
                 return *this;
             }
@@ -398,34 +401,37 @@ namespace ui {
         private:
 
             void attach(T * so) {
-                if (so != nullptr) {
-                    std::lock_guard<std::mutex> g{SpecialObject::MObjects_};
-                    ++(so->refCount_);
-                }
+                if (so != nullptr)
+                    so->addReference();
                 ptr_ = so;
             }
 
             void detach() {
-                if (ptr_ == nullptr)
-                    return;
-                std::lock_guard<std::mutex> g{SpecialObject::MObjects_};
-                if (--(ptr_->refCount_) == 0)
-                    delete ptr_;
+                if (ptr_ != nullptr)
+                    ptr_->release();
             }
 
             T * ptr_;
 
         }; // ui::Canvas::SpecialObject::Ptr
 
+        SpecialObject() = default;
+
+        SpecialObject(SpecialObject const &) = delete;
+
+        SpecialObject & operator = (SpecialObject const &) = delete;
+
         /** Virtual destructor so that special objects do not leak when destroyed. 
+         
+            Releases the object's handle, if any. 
          */
-        virtual ~SpecialObject() = default;
+        virtual ~SpecialObject();
 
-        /** Detaches the object from all its cells. 
-         
-            If the object is not referenced from anywhere else, deletes the object at the end. 
+        /** Returns the number of bytes the object occupies in memory, including the memory it owns. 
          */
-        void detachFromAllCells();
+        virtual size_t bytes() const {
+            return sizeof(SpecialObject);
+        }
 
     protected:
 
@@ -442,17 +448,61 @@ namespace ui {
 
     private:
 
+        void addReference(size_t refs = 1) {
+            refCount_.fetch_add(refs, std::memory_order_relaxed);
+        }
+
+        /** Releases given number of references to the object and deletes the object if they were the last ones. 
+         */
+        void release(size_t refs = 1) {
+            if (refCount_.fetch_sub(refs, std::memory_order_acq_rel) == refs)
+                delete this;
+        }
+
+        /** Returns the handle of the object, obtaining one if the object has not been attached to any cell yet. 
+         */
+        uint32_t handle() {
+            uint32_t result = handle_.load(std::memory_order_acquire);
+            return result != 0 ? result : obtainHandle();
+        }
+
+        uint32_t obtainHandle();
+
+        /** Returns the special object of given handle. 
+         
+            The handle must be in use, i.e. referenced by a cell, so that the chunk it belongs to has been allocated. 
+         */
+        static SpecialObject * Get(uint32_t handle) {
+            ASSERT(handle != 0);
+            SpecialObject ** chunk = Chunks_[handle >> CHUNK_BITS].load(std::memory_order_acquire);
+            ASSERT(chunk != nullptr);
+            return chunk[handle & (CHUNK_SIZE - 1)];
+        }
+
         /** Number of references (cells and Ptr's) that point to the special object. 
          */
-        size_t refCount_ = 0;
+        std::atomic<size_t> refCount_{0};
+
+        /** Handle of the object, 0 if the object does not have one yet. 
+         */
+        std::atomic<uint32_t> handle_{0};
+
+        static constexpr unsigned CHUNK_BITS = 12;
+        static constexpr uint32_t CHUNK_SIZE = 1 << CHUNK_BITS;
+        static constexpr size_t MAX_CHUNKS = 4096;
+
+        /** Chunks of the handle table. The chunks are allocated when needed and never moved, or released so that the handles can be read without locking. 
+         */
+        static std::atomic<SpecialObject **> Chunks_[MAX_CHUNKS];
 
-        /** Map of reachable special objects. 
+        /** Released handles available for reuse and the next handle never used before. 
          */
-        static std::unordered_map<Cell *, SpecialObject *> Objects_;
+        static std::vector<uint32_t> FreeHandles_;
+        static uint32_t NextHandle_;
 
-        /** Guard for multi-threaded access to the special object. 
+        /** Guard for obtaining and releasing handles. 
          */
-        static std::mutex MObjects_;
+        static std::mutex MHandles_;
 
     }; // ui::Canvas::SpecialObject
 
@@ -463,12 +513,15 @@ namespace ui {
     class Canvas::Cell {
         friend class Canvas::Buffer;
         friend class Canvas::SpecialObject;
+        friend class Canvas::StyleTable;
+        friend class Canvas::PackedCell;
     public:
 
         /** Default constructor.
          */
         Cell():
             codepoint_{' '},
+            specialObject_{0},
             fg_{Color::White},
             bg_{Color::Black},
             decor_{Color::White},
@@ -478,18 +531,14 @@ namespace ui {
 
         Cell(Cell const & from):
             codepoint_{from.codepoint_},
+            specialObject_{from.specialObject_},
             fg_{from.fg_},
             bg_{from.bg_},
             decor_{from.decor_},
             font_{from.font_},
             border_{from.border_} {
-            SpecialObject * so = from.specialObject();
-            if (so != nullptr) {
-                std::lock_guard<std::mutex> g{SpecialObject::MObjects_};
-                SpecialObject::Objects_.insert(std::pair<Cell *, SpecialObject*>{this, so});
-                ASSERT(codepoint_ & SPECIAL_OBJECT);
-                ++so->refCount_;
-            }
+            if (specialObject_ != 0)
+                SpecialObject::Get(specialObject_)->addReference();
         }
 
         /** Destroys the cell. 
@@ -504,38 +553,17 @@ namespace ui {
         /** Assignment between cells. 
          
             If the other cell has a special object attached to it, copies the attachment as well, which makes the assignment operator slightly more complex than a simple memory copy. 
-
-            The code is more complex than necessary so that the whole assignment can be done on a single mutex lock. 
          */
         Cell & operator = (Cell const & other) {
             // don't do anything for autoassign
             if (this == & other)
                 return *this;
-            bool hadSo = hasSpecialObject();
-            // casting to void * so that compiler won't give warnings that non POD object is copied, since we deal with the special object later
+            if (other.specialObject_ != 0)
+                SpecialObject::Get(other.specialObject_)->addReference();
+            if (specialObject_ != 0)
+                SpecialObject::Get(specialObject_)->release();
+            // casting to void * so that compiler won't give warnings that non POD object is copied, the reference to the special object has been taken care of already
             memcpy(static_cast<void*>(this), static_cast<void const *>(& other), sizeof(Cell));
-            bool hasSo = hasSpecialObject();
-            if (hadSo) {
-                std::lock_guard<std::mutex> g{SpecialObject::MObjects_};
-                auto i = SpecialObject::Objects_.find(this);
-                if (--(i->second->refCount_) == 0)
-                    delete i->second;
-                if (hasSo) {
-                    // had & has
-                    auto j = SpecialObject::Objects_.find(const_cast<Cell*>(& other));
-                    i->second = j->second;
-                    ++(i->second->refCount_);
-                } else {
-                    // had, but does not - detach
-                    SpecialObject::Objects_.erase(i);
-                }
-            } else if (hasSo) {
-                // did not have special object, but now we do have it
-                std::lock_guard<std::mutex> g{SpecialObject::MObjects_};
-                auto j = SpecialObject::Objects_.find(const_cast<Cell*>(& other));
-                SpecialObject::Objects_.insert(std::pair<Cell*, SpecialObject*>{this, j->second});
-                ++j->second->refCount_;
-            }
             return *this;
         };
 
@@ -548,22 +576,13 @@ namespace ui {
         Cell & stripSpecialObjectAndAssign(Cell const & from) {
             if (& from == this)
                 return *this;
-            bool hadSo = hasSpecialObject();
-            // casting to void * so that compiler won't give warnings that non POD object is copied, since we deal with the special object later
+            if (specialObject_ != 0)
+                SpecialObject::Get(specialObject_)->release();
+            // casting to void * so that compiler won't give warnings that non POD object is copied, the special object is not attached to the copy
             memcpy(static_cast<void*>(this), static_cast<void const *>(& from), sizeof(Cell));
-            {
-                std::lock_guard<std::mutex> g{SpecialObject::MObjects_};
-                if (hadSo) {
-                    auto i = SpecialObject::Objects_.find(this);
-                    if (--(i->second->refCount_) == 0)
-                        delete i->second;
-                    SpecialObject::Objects_.erase(i);
-                }
-                auto j = SpecialObject::Objects_.find(const_cast<Cell*>(& from));
-                if (j != SpecialObject::Objects_.end()) {
-                    j->second->updateFallbackCell(*this, from);
-                    codepoint_ &= ~ SPECIAL_OBJECT;
-                }
+            if (specialObject_ != 0) {
+                specialObject_ = 0;
+                SpecialObject::Get(from.specialObject_)->updateFallbackCell(*this, from);
             }
             return *this;
         }
@@ -574,13 +593,9 @@ namespace ui {
          */
         Cell & detachSpecialObject() {
             if (hasSpecialObject()) {
-                codepoint_ &= ~ SPECIAL_OBJECT;
-                std::lock_guard<std::mutex> g{SpecialObject::MObjects_};
-                auto i = SpecialObject::Objects_.find(this);
-                ASSERT(i != SpecialObject::Objects_.end());
-                if (--(i->second->refCount_) == 0)
-                    delete i->second;
-                SpecialObject::Objects_.erase(i);
+                SpecialObject * so = SpecialObject::Get(specialObject_);
+                specialObject_ = 0;
+                so->release();
             }
             return *this;
         }
@@ -591,44 +606,27 @@ namespace ui {
          */
         Cell & attachSpecialObject(SpecialObject * so) {
             ASSERT(so != nullptr);
-            std::lock_guard<std::mutex> g{SpecialObject::MObjects_};
-            if (hasSpecialObject()) {
-                auto i = SpecialObject::Objects_.find(this);
-                ASSERT(i != SpecialObject::Objects_.end());
-                if (i->second != so) {
-                    if (--(i->second->refCount_) == 0)
-                        delete i->second;
-                    i->second = so;
-                    ++(i->second->refCount_);
-                }
-            } else {
-                SpecialObject::Objects_.insert(std::pair<Cell *, SpecialObject*>{this, so});
-                codepoint_ |= SPECIAL_OBJECT;
-                ++so->refCount_;
-            }
+            so->addReference();
+            detachSpecialObject();
+            specialObject_ = so->handle();
             return *this;
         }
 
         /** Returns true if the cell has a special object attached to it. 
          */
         bool hasSpecialObject() const {
-            return (codepoint_ & SPECIAL_OBJECT) != 0;
+            return specialObject_ != 0;
         }
 
         /** Returns the special object attached to the cell, or nullptr if there is none. 
          */
         SpecialObject * specialObject() const {
-            if (!hasSpecialObject()) {
-                return nullptr;
-            } else {
-                std::lock_guard<std::mutex> g{SpecialObject::MObjects_};
-                auto i = SpecialObject::Objects_.find(const_cast<Cell*>(this));
-                ASSERT(i != SpecialObject::Objects_.end());
-                return i->second;
-            }
+            return hasSpecialObject() ? SpecialObject::Get(specialObject_) : nullptr;
         }
 
         /** \name Codepoint of the cell. 
+         
+            If the cell contains a grapheme cluster, the codepoint is the id of the cluster in the grapheme table of the buffer the cell belongs to, see Canvas::GraphemeTable. Setting the codepoint clears the grapheme cluster.
          */
         //@{
         char32_t codepoint() const {
@@ -636,7 +634,23 @@ namespace ui {
         }
 
         Cell & setCodepoint(char32_t value) {
-            codepoint_ = (codepoint_ & 0xffe00000) + (value & 0x1fffff);
+            codepoint_ = (codepoint_ & 0xbfe00000) + (value & 0x1fffff);
+            return *this;
+        }
+
+        /** Returns true if the cell contains a grapheme cluster of multiple codepoints instead of a single codepoint. 
+         */
+        bool isGrapheme() const {
+            return (codepoint_ & GRAPHEME) != 0;
+        }
+
+        char32_t graphemeId() const {
+            ASSERT(isGrapheme());
+            return codepoint_ & 0x1fffff;
+        }
+
+        Cell & setGrapheme(char32_t id) {
+            codepoint_ = (codepoint_ & 0xbfe00000) + GRAPHEME + (id & 0x1fffff);
             return *this;
         }
         //@}
@@ -719,14 +733,46 @@ namespace ui {
 
     private:
 
-        /** Marker indicating that special object is attached to the cell. 
+        /** Assigns the fill cell to given number of consecutive cells. 
+
+            Instead of going through the assignment operator cell by cell, the references of the fill's special object, if any, are added at once and the special objects of the overwritten cells are released once per run of cells that share them. The cells are then filled by memory copies of exponentially growing size. 
+         */
+        static void Fill(Cell * cells, int n, Cell const & fill) {
+            if (n <= 0)
+                return;
+            // add the new references first as fill may be one of the overwritten cells
+            if (fill.specialObject_ != 0)
+                SpecialObject::Get(fill.specialObject_)->addReference(n);
+            for (int i = 0; i < n; ) {
+                uint32_t so = cells[i++].specialObject_;
+                if (so == 0)
+                    continue;
+                size_t refs = 1;
+                for (; i < n && cells[i].specialObject_ == so; ++i)
+                    ++refs;
+                SpecialObject::Get(so)->release(refs);
+            }
+            // casting to void * so that compiler won't give warnings that non POD object is copied, the references to the special objects have been taken care of already
+            memcpy(static_cast<void*>(cells), static_cast<void const *>(& fill), sizeof(Cell));
+            for (int filled = 1; filled < n; ) {
+                int x = std::min(filled, n - filled);
+                memcpy(static_cast<void*>(cells + filled), static_cast<void const *>(cells), sizeof(Cell) * x);
+                filled += x;
+            }
+        }
+
+        /** Marker indicating that the codepoint is the id of a grapheme cluster. 
          */
-        static const char32_t SPECIAL_OBJECT = 0x80000000;
+        static const char32_t GRAPHEME = 0x40000000;
 
-        /** Codepoint and discriminator between normal and special cell type. 
+        /** Codepoint and discriminator between normal and grapheme cell type. 
          */
         char32_t codepoint_;
 
+        /** Handle of the attached special object, 0 if there is none. 
+         */
+        uint32_t specialObject_;
+
         Color fg_;
         Color bg_;
         Color decor_;
@@ -735,26 +781,348 @@ namespace ui {
 
     }; // ui::Canvas::Cell
 
+    /** Grapheme clusters of a buffer. 
+     
+        Cells hold a single codepoint, combining marks and joined sequences, such as emoji with modifiers, are stored in the grapheme table of the buffer instead and the cell only stores the id of the cluster in place of its codepoint (see Cell::isGrapheme()). This keeps the cells small for the common case of single codepoints, which never touch the table. 
+
+        Clusters are interned so that repeated clusters share the same id. The table does not know which cells refer to its clusters, so the owners of the cells collect the clusters no longer used from time to time, marking the ids their cells still refer to (see collect()). Ids of the collected clusters are reused. When the table is full, new clusters can't be added and only their first codepoint is kept. 
+     */
+    class Canvas::GraphemeTable {
+    public:
+
+        /** Id returned when the table is full. 
+         */
+        static constexpr char32_t Invalid = 0xffffffff;
+
+        /** Returns the id of the given cluster, adding it to the table if not present. 
+         */
+        char32_t intern(std::u32string const & cluster) {
+            ASSERT(cluster.size() > 1);
+            auto i = ids_.find(cluster);
+            if (i != ids_.end())
+                return i->second;
+            char32_t id;
+            if (! free_.empty()) {
+                id = free_.back();
+                free_.pop_back();
+                clusters_[id] = cluster;
+            } else {
+                if (clusters_.size() > MaxId)
+                    return Invalid;
+                id = static_cast<char32_t>(clusters_.size());
+                clusters_.push_back(cluster);
+            }
+            ids_.insert(std::make_pair(cluster, id));
+            return id;
+        }
+
+        std::u32string const & operator [] (char32_t id) const {
+            ASSERT(id < clusters_.size() && ! clusters_[id].empty());
+            return clusters_[id];
+        }
+
+        /** Returns the number of clusters in the table. 
+         */
+        size_t size() const {
+            return clusters_.size() - free_.size();
+        }
+
+        /** Returns true if the table has grown enough since the last collection for another one to be worth it. 
+         */
+        bool needsCollection() const {
+            return size() >= collectAt_;
+        }
+
+        /** Removes the clusters whose ids are not marked as used, ids past the end of the vector are not used. 
+         
+            The next collection is due when the number of clusters doubles. 
+         */
+        void collect(std::vector<bool> const & used) {
+            for (size_t id = 0, e = clusters_.size(); id != e; ++id) {
+                if ((id < used.size() && used[id]) || clusters_[id].empty())
+                    continue;
+                ids_.erase(clusters_[id]);
+                std::u32string{}.swap(clusters_[id]);
+                free_.push_back(static_cast<char32_t>(id));
+            }
+            collectAt_ = std::max(MinCollection, size() * 2);
+        }
+
+        /** Returns the number of bytes the table occupies in memory. 
+         
+            Each cluster is stored twice, in the list and as the key of the index, whose nodes are counted as the key and id with two pointers. 
+         */
+        size_t bytes() const {
+            size_t result = clusters_.capacity() * sizeof(std::u32string) + free_.capacity() * sizeof(char32_t) + ids_.bucket_count() * sizeof(void *);
+            result += ids_.size() * (sizeof(std::pair<std::u32string const, char32_t>) + 2 * sizeof(void *));
+            for (auto const & cluster : clusters_)
+                if (! cluster.empty())
+                    result += 2 * (cluster.capacity() + 1) * sizeof(char32_t);
+            return result;
+        }
+
+    private:
+
+        /** The ids are stored in the codepoint bits of the cell. 
+         */
+        static constexpr char32_t MaxId = 0x1fffff;
+
+        /** Number of clusters below which the table is never collected. 
+         */
+        static constexpr size_t MinCollection = 256;
+
+        /** Clusters by their ids, the collected ones are empty and their ids are in the free list. 
+         */
+        std::vector<std::u32string> clusters_;
+        std::vector<char32_t> free_;
+        std::unordered_map<std::u32string, char32_t> ids_;
+        size_t collectAt_ = MinCollection;
+
+    }; // ui::Canvas::GraphemeTable
+
+    /** Cell packed into its codepoint and the id of its style in a style table. 
+     
+        The codepoint is kept exactly as in the original cell, including the grapheme cluster flag and the unused bits of the buffer, all other attributes of the cell, including the attached special object, are replaced by the style id, which shrinks the cell from 28 to 8 bytes. Packed cells are plain data, they do not hold a reference to their style by themselves, see Canvas::StyleTable.
+     */
+    class Canvas::PackedCell {
+        friend class Canvas::StyleTable;
+        friend class Canvas::Buffer;
+    public:
+
+        /** Packed cells are left uninitialized so that rows of them can be allocated cheaply. 
+         */
+        PackedCell() = default;
+
+        char32_t codepoint() const {
+            return codepoint_ & 0x1fffff;
+        }
+
+        bool isGrapheme() const {
+            return (codepoint_ & Cell::GRAPHEME) != 0;
+        }
+
+        char32_t graphemeId() const {
+            ASSERT(isGrapheme());
+            return codepoint_ & 0x1fffff;
+        }
+
+        uint32_t style() const {
+            return style_;
+        }
+
+        /** Returns the codepoint together with the flags stored in its unused bits so that the cell can be serialized. 
+         */
+        char32_t rawCodepoint() const {
+            return codepoint_;
+        }
+
+        /** Recreates a serialized packed cell from its raw codepoint and style id. 
+         
+            The cell takes over the style reference of the serialized cell. 
+         */
+        static PackedCell FromRaw(char32_t rawCodepoint, uint32_t style) {
+            return PackedCell{rawCodepoint, style};
+        }
+
+    private:
+
+        PackedCell(char32_t codepoint, uint32_t style):
+            codepoint_{codepoint},
+            style_{style} {
+        }
+
+        char32_t codepoint_;
+        uint32_t style_;
+
+    }; // ui::Canvas::PackedCell
+
+    /** Interned styles of cells. 
+     
+        A style is everything in a cell but its codepoint, i.e. the colors, font, border and the attached special object. Cells stored in large numbers, such as the terminal history, are packed into their codepoint and the id of their style in the table (see Canvas::PackedCell) so that each distinct style is stored only once. 
+
+        Styles are reference counted, every packed cell holds a reference to its style which must be returned by release() when the cell is discarded. Styles no longer referenced are kept for a while as they are likely to be used again soon, once there are too many of them they are removed, detaching their special objects, and their ids are reused. The table is not thread safe. 
+     */
+    class Canvas::StyleTable {
+    public:
+
+        /** Packs the cell, adding a reference to its style. 
+         */
+        PackedCell pack(Cell const & cell);
+
+        /** Packs a row of cells. 
+         
+            Consecutive cells mostly share their style so that the style is only looked up when it changes. 
+         */
+        void pack(Cell const * cells, int count, PackedCell * into) {
+            for (int i = 0; i < count; ) {
+                into[i] = pack(cells[i]);
+                uint32_t id = into[i].style_;
+                int run = i + 1;
+                for (; run < count && SameStyle(cells[run], cells[i]); ++run)
+                    into[run] = PackedCell{cells[run].codepoint_, id};
+                styles_[id].refs += static_cast<uint32_t>(run - i - 1);
+                i = run;
+            }
+        }
+
+        /** Unpacks the cell into a full cell. 
+         */
+        void unpack(PackedCell const & cell, Cell & into) const {
+            into = style(cell.style_);
+            into.codepoint_ = cell.codepoint_;
+        }
+
+        void unpack(PackedCell const * cells, int count, Cell * into) const {
+            for (int i = 0; i < count; ++i)
+                unpack(cells[i], into[i]);
+        }
+
+        /** Releases the reference to the style of the cell. 
+         */
+        void release(PackedCell const & cell) {
+            release(cell.style_, 1);
+        }
+
+        void release(PackedCell const * cells, int count) {
+            for (int i = 0; i < count; ) {
+                int run = i + 1;
+                while (run < count && cells[run].style_ == cells[i].style_)
+                    ++run;
+                release(cells[i].style_, static_cast<uint32_t>(run - i));
+                i = run;
+            }
+        }
+
+        /** Releases given number of references to the style of given id. 
+         */
+        void release(uint32_t id, uint32_t refs);
+
+        /** Removes the styles that are no longer referenced. 
+         */
+        void collect();
+
+        /** Returns the style of given id as a cell with codepoint 0. 
+         */
+        Cell const & style(uint32_t id) const {
+            ASSERT(id < styles_.size());
+            return styles_[id].style;
+        }
+
+        /** Returns the number of styles in use. 
+         */
+        size_t size() const {
+            return styles_.size() - freeIds_.size() - unused_;
+        }
+
+        /** Returns the number of bytes the table occupies in memory, not counting the special objects its styles refer to. 
+         */
+        size_t bytes() const {
+            return styles_.capacity() * sizeof(Style) + (freeIds_.capacity() + index_.capacity()) * sizeof(uint32_t);
+        }
+
+        /** Adds the special objects the styles refer to to the set. 
+         */
+        void addSpecialObjectsTo(std::unordered_set<SpecialObject *> & into) const {
+            for (auto const & i : specialObjects_)
+                into.insert(i.first);
+        }
+
+        /** Returns the number of bytes the special objects the styles refer to occupy, each object counted once. 
+         */
+        size_t specialObjectBytes() const {
+            return specialObjectBytes_;
+        }
+
+    private:
+
+        struct Style {
+            Cell style;
+            uint32_t refs;
+        };
+
+        /** Minimal number of unreferenced styles before they are collected. 
+         */
+        static constexpr size_t MIN_UNUSED = 1024;
+
+        /** Marks empty slot in the index. 
+         */
+        static constexpr uint32_t EMPTY = 0xffffffff;
+
+        /** Rebuilds the index of styles with given capacity, which must be a power of two. 
+         */
+        void rebuildIndex(size_t capacity);
+
+        /** Keeps track of the special object of a style that has been added to, or removed from the table. 
+         */
+        void addSpecialObject(SpecialObject * so);
+        void removeSpecialObject(SpecialObject * so);
+
+        /** Hash of the cell's style, ignores the codepoint. 
+         */
+        static size_t StyleHash(Cell const & cell);
+
+        /** Compares the styles of two cells. 
+         
+            The style members of the cell are adjacent without any padding between them so that they can be compared at once. 
+         */
+        static bool SameStyle(Cell const & a, Cell const & b) {
+            static_assert(offsetof(Cell, border_) + sizeof(Border) - offsetof(Cell, specialObject_) == sizeof(uint32_t) + 3 * sizeof(Color) + sizeof(Font) + sizeof(Border), "Padding between cell style members");
+            return memcmp(& a.specialObject_, & b.specialObject_, offsetof(Cell, border_) + sizeof(Border) - offsetof(Cell, specialObject_)) == 0;
+        }
+
+        /** The styles indexed by their ids. Released ids are reset to default cell and kept in the free list. 
+         */
+        std::vector<Style> styles_;
+        std::vector<uint32_t> freeIds_;
+
+        /** Open addressing hash index of the styles in use with linear probing. Styles are only removed from the table by collect(), which rebuilds the whole index so that the index does not need tombstones. 
+         */
+        std::vector<uint32_t> index_;
+
+        /** Number of styles in the table which are not referenced. 
+         */
+        size_t unused_ = 0;
+
+        /** Styles packed most recently, checked before the index as the same few styles, such as single and double width characters, tend to alternate. 
+         */
+        static constexpr size_t RECENT = 4;
+        uint32_t recent_[RECENT] = { EMPTY, EMPTY, EMPTY, EMPTY };
+        size_t nextRecent_ = 0;
+
+        /** Special objects of the styles, with the number of styles referring to each and the bytes counted for the object when it was added. 
+         */
+        std::unordered_map<SpecialObject *, std::pair<uint32_t, size_t>> specialObjects_;
+        size_t specialObjectBytes_ = 0;
+
+    }; // ui::Canvas::StyleTable
+
     class Canvas::Buffer {
     public:
 
         explicit Buffer(Size const & size):
-            size_{size} {
+            size_{size},
+            graphemes_{std::make_shared<GraphemeTable>()} {
             create(size);
         }
 
         Buffer(Buffer && from) noexcept:
             size_{from.size_},
-            rows_{from.rows_} {
+            ring_{from.ring_},
+            rows_{from.rows_},
+            graphemes_{std::move(from.graphemes_)} {
             from.size_ = Size{0,0};
+            from.ring_ = nullptr;
             from.rows_ = nullptr;
         }
 
         Buffer & operator = (Buffer && from) noexcept {
             clear();
             size_ = from.size_;
+            ring_ = from.ring_;
             rows_ = from.rows_;
+            graphemes_ = std::move(from.graphemes_);
             from.size_ = Size{0,0};
+            from.ring_ = nullptr;
             from.rows_ = nullptr;
             return *this;
         }          
@@ -807,6 +1175,101 @@ namespace ui {
             return result;
         }
 
+        /** Returns the number of bytes the cells and rows of the buffer occupy. 
+         
+            The grapheme table, which may be shared with other buffers, and the special objects attached to the cells are not included. 
+         */
+        size_t bytes() const {
+            return static_cast<size_t>(size_.width()) * static_cast<size_t>(size_.height()) * sizeof(Cell) + static_cast<size_t>(size_.height()) * 2 * sizeof(Cell *);
+        }
+
+        /** Adds the special objects attached to the cells of the buffer to the set. 
+         */
+        void addSpecialObjectsTo(std::unordered_set<SpecialObject *> & into) const {
+            for (int row = 0; row < size_.height(); ++row)
+                for (Cell const * c = rows_[row], * e = rows_[row] + size_.width(); c != e; ++c)
+                    if (c->hasSpecialObject())
+                        into.insert(c->specialObject());
+        }
+
+        /** \name Grapheme clusters
+         */
+        //@{
+
+        GraphemeTable const & graphemes() const {
+            return *graphemes_;
+        }
+
+        GraphemeTable & graphemes() {
+            return *graphemes_;
+        }
+
+        /** Makes the buffer use the same grapheme table as the other buffer so that cells can be copied between the two without translating the grapheme ids. 
+         */
+        void shareGraphemes(Buffer const & other) {
+            graphemes_ = other.graphemes_;
+        }
+
+        /** Returns the codepoints of the given cell, which must be one of buffer's cells. 
+         */
+        std::u32string codepoints(Cell const & cell) const {
+            if (cell.isGrapheme())
+                return (*graphemes_)[cell.graphemeId()];
+            return std::u32string(1, cell.codepoint());
+        }
+
+        /** Returns the first codepoint of the given cell, i.e. the base character of a grapheme cluster. 
+         */
+        char32_t baseCodepoint(Cell const & cell) const {
+            if (cell.isGrapheme())
+                return (*graphemes_)[cell.graphemeId()][0];
+            return cell.codepoint();
+        }
+
+        /** Marks the ids of the grapheme clusters the cells of the buffer refer to, growing the vector as needed. 
+         */
+        void markGraphemes(std::vector<bool> & used) const {
+            for (int row = 0; row < size_.height(); ++row) {
+                for (Cell const * c = rows_[row], * e = rows_[row] + size_.width(); c != e; ++c) {
+                    if (! c->isGrapheme())
+                        continue;
+                    if (c->graphemeId() >= used.size())
+                        used.resize(c->graphemeId() + 1);
+                    used[c->graphemeId()] = true;
+                }
+            }
+        }
+
+        /** Removes the grapheme clusters the cells of the buffer no longer refer to, if the table is due for collection. 
+         
+            The table must not be shared with other buffers. 
+         */
+        void collectGraphemes() {
+            ASSERT(graphemes_.use_count() == 1);
+            if (! graphemes_->needsCollection())
+                return;
+            std::vector<bool> used;
+            markGraphemes(used);
+            graphemes_->collect(used);
+        }
+
+        /** Translates the grapheme cluster of a cell copied from a buffer with the given grapheme table to this buffer's table. 
+         
+            Does nothing if the cell does not contain grapheme cluster, or if the table is shared. 
+         */
+        void importGrapheme(Cell & cell, GraphemeTable const & from) {
+            if (! cell.isGrapheme() || & from == graphemes_.get())
+                return;
+            std::u32string const & cluster = from[cell.graphemeId()];
+            char32_t id = graphemes_->intern(cluster);
+            if (id == GraphemeTable::Invalid)
+                cell.setCodepoint(cluster[0]);
+            else
+                cell.setGrapheme(id);
+        }
+
+        //@}
+
         /** Returns the cursor properties. 
          */
         Cursor const & cursor() const {
@@ -838,20 +1301,8 @@ namespace ui {
             Exponentially increases the size of copied cells for performance.
          */
         void fillRow(int row, Cell const & fill, int from, int cols) {
-            Cell * r = rows_[row];
-            for (int e = from + cols; from < e; ++from)
-                r[from] = fill;
-            /*
-            r[from] = fill;
-            int i = 1;
-            int next = 2;
-            while (next < cols) {
-                memcpy(r + from + i, r + from, sizeof(Cell) * i);
-                i = next;
-                next *= 2;
-            }
-            memcpy(r + from + i, r + from, sizeof(Cell) * (cols - i));
-            */
+            ASSERT(row >= 0 && row < size_.height() && from >= 0 && from + cols <= size_.width());
+            Cell::Fill(rows_[row] + from, cols, fill);
         }
 
     protected:
@@ -875,13 +1326,17 @@ namespace ui {
         /** Returns the value of the unused bits in the given cell's codepoint so that the buffer can store extra information for each cell. 
          */
         static char32_t GetUnusedBits(Cell const & cell) {
-            return cell.codepoint_ & 0x7fe00000;
+            return cell.codepoint_ & 0x3fe00000;
+        }
+
+        static char32_t GetUnusedBits(PackedCell const & cell) {
+            return cell.codepoint_ & 0x3fe00000;
         }
 
         /** Sets the unused bytes value for the given cell to store extra information by the buffer. 
          */
         static void SetUnusedBits(Cell & cell, char32_t value) {
-            cell.codepoint_ = (cell.codepoint_ & 0x801fffff) + (value & 0x7fe00000);
+            cell.codepoint_ = (cell.codepoint_ & 0xc01fffff) + (value & 0x3fe00000);
         }
 
         /** Unused bits flag that confirms that the cell has a visible cursor in it. 
@@ -890,25 +1345,57 @@ namespace ui {
 
     protected:
 
+        /** Scrolls the rows between top (inclusive) and bottom (exclusive) up by given number of lines, or down if the number is negative. 
+
+            The rows scrolled out of the region reappear at its other end with their contents intact and it is up to the caller to clear them. Scrolling the whole buffer only moves the start of the row ring, otherwise the row pointers of the region are rotated at once, regardless of the number of lines. 
+         */
+        void scrollRows(int top, int bottom, int lines) {
+            ASSERT(top >= 0 && top < bottom && bottom <= size_.height());
+            int height = bottom - top;
+            lines %= height;
+            if (lines < 0)
+                lines += height;
+            if (lines == 0)
+                return;
+            if (top == 0 && bottom == size_.height()) {
+                rows_ = ring_ + (rows_ - ring_ + lines) % height;
+            } else {
+                std::rotate(rows_ + top, rows_ + top + lines, rows_ + bottom);
+                // keep the other half of the ring in sync
+                int start = static_cast<int>(rows_ - ring_);
+                for (int i = start + top, e = start + bottom; i < e; ++i)
+                    ring_[i < size_.height() ? i + size_.height() : i - size_.height()] = ring_[i];
+            }
+        }
+
+        /** The rows are stored in a ring, which is twice the height of the buffer and whose second half mirrors the first one so that the rows_ window into it is always contiguous and cells are accessed without any wrapping. 
+         */
         void create(Size const & size) {
-            rows_ = new Cell*[size.height()];
-            for (int i = 0; i < size.height(); ++i)
-                rows_[i] = new Cell[size.width()];
+            ring_ = new Cell*[size.height() * 2];
+            for (int i = 0; i < size.height(); ++i) {
+                ring_[i] = new Cell[size.width()];
+                ring_[i + size.height()] = ring_[i];
+            }
+            rows_ = ring_;
             size_ = size;
         }
 
         void clear() {
             // rows can be nullptr if they have been backed up by a swap when resizing
-            if (rows_ != nullptr) {
+            if (ring_ != nullptr) {
                 for (int i = 0; i < size_.height(); ++i)
-                    delete [] rows_[i];
-                delete [] rows_;
+                    delete [] ring_[i];
+                delete [] ring_;
             }
             size_ = Size{0,0};
         }
 
         Size size_;
+        /** The row ring and the window of its height that is the buffer's rows. 
+         */
+        Cell ** ring_;
         Cell ** rows_;
+        std::shared_ptr<GraphemeTable> graphemes_;
 
         Cursor cursor_;
         Point cursorPosition_;
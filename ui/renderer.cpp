@@ -140,6 +140,8 @@ namespace ui {
         UI_THREAD_ONLY;
         if (renderWidget_ == nullptr)
             return;
+        // the grapheme clusters imported by previous paints which are no longer visible are removed before new ones are added
+        buffer_.collectGraphemes();
         // paint the widget on the buffer
         renderWidget_->paint();
         // render the visible area of the widget, still under the priority lock
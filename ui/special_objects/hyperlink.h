@@ -86,6 +86,10 @@ namespace ui {
             url_ = url;
         }
 
+        size_t bytes() const override {
+            return sizeof(Hyperlink) + url_.capacity();
+        }
+
         bool active() const {
             return active_;
         }
@@ -0,0 +1,223 @@
+#include "helpers/tests.h"
+
+#include "ui/canvas.h"
+
+using namespace ui;
+
+TEST(ui_canvas, graphemeClusters) {
+    Canvas::Buffer buffer{Size{4, 1}};
+    Canvas::GraphemeTable & graphemes = buffer.graphemes();
+    char32_t id = graphemes.intern(U"e\u0301");
+    EXPECT(graphemes.intern(U"a\u0301") == id + 1);
+    EXPECT(graphemes.intern(U"e\u0301") == id);
+    Canvas::Cell & c = buffer.at(0, 0);
+    c.setGrapheme(id);
+    EXPECT(c.isGrapheme());
+    EXPECT(buffer.codepoints(c) == U"e\u0301");
+    EXPECT(buffer.baseCodepoint(c) == U'e');
+    // setting a codepoint clears the grapheme cluster
+    c.setCodepoint('x');
+    EXPECT(! c.isGrapheme());
+    EXPECT(buffer.codepoints(c) == U"x");
+}
+
+TEST(ui_canvas, graphemeClustersCopiedBetweenBuffers) {
+    Canvas::Buffer from{Size{2, 1}};
+    from.graphemes().intern(U"a\u0301");
+    from.at(0, 0).setGrapheme(from.graphemes().intern(U"e\u0301"));
+    from.at(1, 0).setCodepoint('x');
+    Canvas::Buffer to{Size{2, 1}};
+    Canvas{to}.drawBuffer(from, Point{0, 0});
+    EXPECT(to.codepoints(to.at(0, 0)) == U"e\u0301");
+    EXPECT_EQ(to.graphemes().size(), 1u);
+    EXPECT(! to.at(1, 0).isGrapheme());
+    // buffers sharing the table copy the ids as they are
+    Canvas::Buffer shared{Size{2, 1}};
+    shared.shareGraphemes(from);
+    Canvas{shared}.drawBuffer(from, Point{0, 0});
+    EXPECT(shared.at(0, 0).graphemeId() == from.at(0, 0).graphemeId());
+}
+
+TEST(ui_canvas, graphemeClustersCollected) {
+    Canvas::Buffer buffer{Size{2, 1}};
+    Canvas::GraphemeTable & graphemes = buffer.graphemes();
+    std::u32string cluster{U"a\u0301"};
+    char32_t used = 0;
+    // fill the table until it is due for collection, only one cluster remains in the buffer
+    while (! graphemes.needsCollection()) {
+        ++cluster[0];
+        used = graphemes.intern(cluster);
+    }
+    size_t size = graphemes.size();
+    buffer.at(0, 0).setGrapheme(used);
+    buffer.collectGraphemes();
+    EXPECT_EQ(graphemes.size(), 1u);
+    EXPECT(buffer.codepoints(buffer.at(0, 0)) == cluster);
+    // the ids of collected clusters are reused
+    EXPECT(graphemes.intern(U"e\u0301") < size);
+    EXPECT(graphemes.intern(cluster) == used);
+    EXPECT(! graphemes.needsCollection());
+}
+
+namespace {
+
+    class TestObject : public Canvas::SpecialObject {
+    public:
+        explicit TestObject(bool & deleted):
+            deleted_{deleted} {
+        }
+
+        ~TestObject() override {
+            deleted_ = true;
+        }
+
+    protected:
+        void updateFallbackCell(Canvas::Cell & fallback, Canvas::Cell const & original) override {
+            MARK_AS_UNUSED(original);
+            fallback.setCodepoint('f');
+        }
+
+    private:
+        bool & deleted_;
+    };
+
+}
+
+TEST(ui_canvas, specialObjectReferences) {
+    bool deleted = false;
+    TestObject * so = new TestObject{deleted};
+    Canvas::Buffer buffer{Size{3, 1}};
+    buffer.at(0, 0).attachSpecialObject(so);
+    buffer.at(1, 0) = buffer.at(0, 0);
+    {
+        Canvas::Cell copy{buffer.at(1, 0)};
+        EXPECT(copy.specialObject() == so);
+        Canvas::Cell fallback;
+        fallback.stripSpecialObjectAndAssign(copy);
+        EXPECT(! fallback.hasSpecialObject());
+        EXPECT(fallback.codepoint() == 'f');
+    }
+    buffer.at(0, 0).detachSpecialObject();
+    EXPECT(! deleted);
+    EXPECT(buffer.at(1, 0).specialObject() == so);
+    // the last reference deletes the object
+    buffer.at(1, 0) = buffer.at(2, 0);
+    EXPECT(deleted);
+}
+
+TEST(ui_canvas, fillReleasesSpecialObjects) {
+    bool deleted = false;
+    bool fillDeleted = false;
+    Canvas::Buffer buffer{Size{7, 1}};
+    Canvas canvas{buffer};
+    Canvas::Cell special;
+    special.attachSpecialObject(new TestObject{deleted});
+    canvas.fill(Rect{Point{1, 0}, Size{4, 1}}, special);
+    special.attachSpecialObject(new TestObject{fillDeleted});
+    EXPECT(! deleted);
+    canvas.fill(Rect{Point{0, 0}, Size{3, 1}}, special);
+    EXPECT(! deleted);
+    EXPECT(buffer.at(2, 0).specialObject() == special.specialObject());
+    canvas.fill(Rect{Point{3, 0}, Size{4, 1}}, special);
+    EXPECT(deleted);
+    special.detachSpecialObject();
+    EXPECT(! fillDeleted);
+    // fill with one of the filled cells
+    buffer.fillRow(0, buffer.at(6, 0), 0, 7);
+    EXPECT(! fillDeleted);
+    canvas.fill(Rect{buffer.size()}, Canvas::Cell{});
+    EXPECT(fillDeleted);
+    EXPECT(buffer.at(6, 0).codepoint() == ' ');
+}
+
+TEST(ui_canvas, styleTable) {
+    bool deleted = false;
+    Canvas::StyleTable styles;
+    Canvas::Cell cells[3];
+    cells[0].setCodepoint('a').setFg(Color::Red);
+    cells[1].setCodepoint('b').setFg(Color::Red);
+    cells[2].setCodepoint('c').attachSpecialObject(new TestObject{deleted});
+    Canvas::PackedCell packed[3];
+    styles.pack(cells, 3, packed);
+    EXPECT_EQ(styles.size(), 2u);
+    EXPECT_EQ(packed[0].style(), packed[1].style());
+    Canvas::Cell unpacked;
+    styles.unpack(packed[1], unpacked);
+    EXPECT(unpacked.codepoint() == 'b');
+    EXPECT(unpacked.fg() == Color::Red);
+    // the style keeps the special object alive
+    cells[2].detachSpecialObject();
+    unpacked.detachSpecialObject();
+    EXPECT(! deleted);
+    styles.unpack(packed[2], unpacked);
+    EXPECT(unpacked.codepoint() == 'c');
+    EXPECT(unpacked.hasSpecialObject());
+    unpacked.detachSpecialObject();
+    // unreferenced styles are kept until collected
+    styles.release(packed, 3);
+    EXPECT_EQ(styles.size(), 0u);
+    EXPECT(! deleted);
+    styles.collect();
+    EXPECT(deleted);
+}
+
+TEST(ui_canvas, styleTableSpecialObjectBytes) {
+    bool deleted = false;
+    Canvas::StyleTable styles;
+    TestObject * so = new TestObject{deleted};
+    Canvas::Cell cells[2];
+    cells[0].setCodepoint('a').attachSpecialObject(so);
+    cells[1].setCodepoint('b').setFg(Color::Red).attachSpecialObject(so);
+    Canvas::PackedCell packed[2];
+    styles.pack(cells, 2, packed);
+    // two styles refer to the object, which is counted once
+    EXPECT_EQ(styles.size(), 2u);
+    EXPECT_EQ(styles.specialObjectBytes(), so->bytes());
+    std::unordered_set<Canvas::SpecialObject *> objects;
+    styles.addSpecialObjectsTo(objects);
+    EXPECT_EQ(objects.size(), 1u);
+    cells[0].detachSpecialObject();
+    cells[1].detachSpecialObject();
+    styles.release(packed, 1);
+    styles.collect();
+    EXPECT_EQ(styles.specialObjectBytes(), so->bytes());
+    styles.release(packed + 1, 1);
+    styles.collect();
+    EXPECT_EQ(styles.specialObjectBytes(), 0u);
+    EXPECT(deleted);
+}
+
+namespace {
+
+    class ScrolledBuffer : public Canvas::Buffer {
+    public:
+        using Canvas::Buffer::Buffer;
+        using Canvas::Buffer::scrollRows;
+    };
+
+    std::string Column(Canvas::Buffer const & buffer) {
+        std::string result;
+        for (int row = 0; row < buffer.height(); ++row)
+            result.push_back(static_cast<char>(buffer.at(0, row).codepoint()));
+        return result;
+    }
+
+}
+
+TEST(ui_canvas, scrollRows) {
+    ScrolledBuffer buffer{Size{1, 5}};
+    for (int row = 0; row < 5; ++row)
+        buffer.at(0, row).setCodepoint('a' + row);
+    // whole buffer
+    buffer.scrollRows(0, 5, 2);
+    EXPECT_EQ(Column(buffer), "cdeab");
+    buffer.scrollRows(0, 5, 4);
+    EXPECT_EQ(Column(buffer), "bcdea");
+    // regions, including ones crossing the end of the ring
+    buffer.scrollRows(1, 4, 1);
+    EXPECT_EQ(Column(buffer), "bdeca");
+    buffer.scrollRows(2, 5, -1);
+    EXPECT_EQ(Column(buffer), "bdaec");
+    buffer.scrollRows(0, 5, 3);
+    EXPECT_EQ(Column(buffer), "ecbda");
+}